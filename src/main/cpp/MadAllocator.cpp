@@ -0,0 +1,237 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadAllocator.hpp"
+#include "sqlite3.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+using namespace madsqlite;
+using namespace std;
+
+namespace {
+
+const int sizeClassCount = 8;
+const int smallestSizeClass = 32;
+
+/**
+ * Precedes every block of the thread caching allocator, 16 bytes to keep the blocks 16 byte aligned.
+ */
+struct BlockHeader {
+    int size;
+    int sizeClass;
+    long long reserved;
+};
+
+/**
+ * The blocks a thread keeps for reuse, returned to the system when the thread exits.
+ */
+struct ThreadCache {
+    vector<void *> blocks[sizeClassCount];
+    atomic<long long> hits{0};
+    atomic<long long> misses{0};
+
+    ThreadCache();
+
+    ~ThreadCache();
+};
+
+}
+
+static mutex allocatorMutex;
+static bool hasSystemMethods = false;
+static sqlite3_mem_methods systemMethods;
+static void *memsys5Heap = nullptr;
+static size_t memsys5HeapSize = 0;
+static atomic<int> threadCacheBlocks{64};
+// guards the registry of thread caches, separate from allocatorMutex as sqlite allocates while being installed
+static mutex threadCachesMutex;
+static unordered_set<ThreadCache *> threadCaches;
+// the counters of exited threads
+static long long retiredHits = 0;
+static long long retiredMisses = 0;
+
+ThreadCache::ThreadCache() {
+    lock_guard<mutex> guard(threadCachesMutex);
+    threadCaches.insert(this);
+}
+
+static thread_local ThreadCache threadCache;
+// trivially destructible, so it stays readable by the destructors of thread locals which run after the cache's
+static thread_local bool isThreadCacheDestroyed = false;
+
+ThreadCache::~ThreadCache() {
+    isThreadCacheDestroyed = true;
+    for (auto &&sizeClass : blocks) {
+        for (auto block : sizeClass) {
+            free(block);
+        }
+    }
+    lock_guard<mutex> guard(threadCachesMutex);
+    retiredHits += hits;
+    retiredMisses += misses;
+    threadCaches.erase(this);
+}
+
+/**
+ * @return the cache of the calling thread, or nullptr once the thread is exiting and its cache was destroyed. sqlite
+ * may still allocate from the destructors of other thread locals, those blocks bypass the cache.
+ */
+static ThreadCache *threadCacheOrNull() {
+    return isThreadCacheDestroyed ? nullptr : &threadCache;
+}
+
+static int sizeClassOf(int size) {
+    int classSize = smallestSizeClass;
+    for (int i = 0; i < sizeClassCount; ++i, classSize <<= 1) {
+        if (size <= classSize) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static BlockHeader *headerOf(void *memory) {
+    return reinterpret_cast<BlockHeader *>(static_cast<char *>(memory) - sizeof(BlockHeader));
+}
+
+//region sqlite3_mem_methods
+
+static int cacheRoundup(int size) {
+    int sizeClass = sizeClassOf(size);
+    return sizeClass < 0 ? (size + 7) & ~7 : smallestSizeClass << sizeClass;
+}
+
+static void *cacheMalloc(int size) {
+    int sizeClass = sizeClassOf(size);
+    auto cache = threadCacheOrNull();
+    if (cache && sizeClass >= 0 && !cache->blocks[sizeClass].empty()) {
+        auto header = static_cast<BlockHeader *>(cache->blocks[sizeClass].back());
+        cache->blocks[sizeClass].pop_back();
+        cache->hits.store(cache->hits.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return header + 1;
+    }
+    if (cache) {
+        cache->misses.store(cache->misses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    int blockSize = cacheRoundup(size);
+    auto header = static_cast<BlockHeader *>(malloc(sizeof(BlockHeader) + blockSize));
+    if (!header) {
+        return nullptr;
+    }
+    header->size = blockSize;
+    header->sizeClass = sizeClass;
+    return header + 1;
+}
+
+static void cacheFree(void *memory) {
+    auto header = headerOf(memory);
+    auto cache = threadCacheOrNull();
+    if (cache && header->sizeClass >= 0) {
+        auto &blocks = cache->blocks[header->sizeClass];
+        if ((int) blocks.size() < threadCacheBlocks) {
+            blocks.push_back(header);
+            return;
+        }
+    }
+    free(header);
+}
+
+static void *cacheRealloc(void *memory, int size) {
+    auto header = headerOf(memory);
+    if (size <= header->size && sizeClassOf(size) == header->sizeClass) {
+        return memory;
+    }
+    void *resized = cacheMalloc(size);
+    if (resized) {
+        memcpy(resized, memory, (size_t) min(size, header->size));
+        cacheFree(memory);
+    }
+    return resized;
+}
+
+static int cacheSize(void *memory) {
+    return headerOf(memory)->size;
+}
+
+static int cacheInit(void *) {
+    return SQLITE_OK;
+}
+
+static void cacheShutdown(void *) {}
+
+static const sqlite3_mem_methods threadCacheMethods = {
+        cacheMalloc,
+        cacheFree,
+        cacheRealloc,
+        cacheSize,
+        cacheRoundup,
+        cacheInit,
+        cacheShutdown,
+        nullptr,
+};
+
+//endregion
+
+//region MadAllocator
+
+bool MadAllocator::install(MadDatabase::AllocatorOptions const &options) {
+    lock_guard<mutex> guard(allocatorMutex);
+    sqlite3_shutdown();
+    if (!hasSystemMethods) {
+        hasSystemMethods = sqlite3_config(SQLITE_CONFIG_GETMALLOC, &systemMethods) == SQLITE_OK;
+    }
+    int rc = SQLITE_ERROR;
+    switch (options.allocator) {
+        case MadDatabase::Allocator::SYSTEM:
+            rc = hasSystemMethods ? sqlite3_config(SQLITE_CONFIG_MALLOC, &systemMethods) : SQLITE_ERROR;
+            break;
+        case MadDatabase::Allocator::THREAD_CACHE:
+            threadCacheBlocks = max(options.threadCacheBlocks, 0);
+            rc = sqlite3_config(SQLITE_CONFIG_MALLOC, &threadCacheMethods);
+            break;
+        case MadDatabase::Allocator::MEMSYS5:
+            // the heap is kept for the life of the process, sqlite may not have released it until shut down
+            if (memsys5HeapSize < options.heapBytes) {
+                free(memsys5Heap);
+                memsys5Heap = malloc(options.heapBytes);
+                memsys5HeapSize = memsys5Heap ? options.heapBytes : 0;
+            }
+            rc = memsys5Heap ? sqlite3_config(SQLITE_CONFIG_HEAP, memsys5Heap, (int) memsys5HeapSize,
+                                              options.minAllocation) : SQLITE_NOMEM;
+            break;
+    }
+    if (rc == SQLITE_OK && options.lookasideSlotSize > 0 && options.lookasideSlots > 0) {
+        rc = sqlite3_config(SQLITE_CONFIG_LOOKASIDE, options.lookasideSlotSize, options.lookasideSlots);
+    }
+    return sqlite3_initialize() == SQLITE_OK && rc == SQLITE_OK;
+}
+
+MadDatabase::AllocatorStats MadAllocator::getStats() {
+    MadDatabase::AllocatorStats stats;
+    sqlite3_int64 current = 0, highwater = 0;
+    sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &current, &highwater, 0);
+    stats.memoryUsed = current;
+    stats.memoryHighwater = highwater;
+    sqlite3_status64(SQLITE_STATUS_MALLOC_COUNT, &current, &highwater, 0);
+    stats.allocations = current;
+    sqlite3_status64(SQLITE_STATUS_MALLOC_SIZE, &current, &highwater, 0);
+    stats.largestAllocation = highwater;
+
+    lock_guard<mutex> guard(threadCachesMutex);
+    stats.threadCacheHits = retiredHits;
+    stats.threadCacheMisses = retiredMisses;
+    for (auto cache : threadCaches) {
+        stats.threadCacheHits += cache->hits;
+        stats.threadCacheMisses += cache->misses;
+    }
+    return stats;
+}
+
+//endregion
@@ -0,0 +1,28 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_MADALLOCATOR_HPP
+#define PROJECT_MADALLOCATOR_HPP
+
+#include "MadDatabase.hpp"
+
+namespace madsqlite {
+
+/**
+ * Configures the memory allocator used by sqlite: the system malloc, a thread caching pool implementing
+ * sqlite3_mem_methods or the sqlite MEMSYS5 buddy allocator over a fixed heap.
+ */
+class MadAllocator {
+
+public:
+
+    static bool install(MadDatabase::AllocatorOptions const &options);
+
+    static MadDatabase::AllocatorStats getStats();
+
+};
+
+}
+
+#endif //PROJECT_MADALLOCATOR_HPP
@@ -0,0 +1,707 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadCompressVfs.hpp"
+#include "MadLz4.hpp"
+#include "sqlite3.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace madsqlite;
+using namespace std;
+
+namespace {
+
+const char fileMagic[16] = "MadSqlite LZ4 2";
+const char recordMagic[4] = {'M', 'P', 'G', '2'};
+const sqlite3_int64 headerSpacing = 512;
+const sqlite3_int64 dataStart = 1024;
+const int extentAlignment = 128;
+const uint32_t compressedFlag = 1;
+
+struct FileHeader {
+    char magic[16];
+    uint32_t pageSize;
+    uint32_t pageCount;
+    uint64_t generation;
+    uint64_t sequence;
+    // records of lower sequences were synced, later ones may be torn
+    uint64_t syncedSequence;
+    // a random number of the file seeding the record checksums
+    uint32_t salt;
+    uint32_t checksum;
+};
+
+struct RecordHeader {
+    char magic[4];
+    uint32_t pageNumber;
+    uint32_t storedSize;
+    uint32_t extentSize;
+    uint64_t sequence;
+    uint32_t flags;
+    uint32_t dataChecksum;
+    uint32_t reserved;
+    uint32_t checksum;
+};
+
+/**
+ * Where the current record of a page is, an offset of 0 for a page never written.
+ */
+struct PageLocation {
+    sqlite3_int64 offset = 0;
+    uint32_t storedSize = 0;
+    uint32_t extentSize = 0;
+    uint64_t sequence = 0;
+    uint32_t dataChecksum = 0;
+    bool isCompressed = false;
+};
+
+/**
+ * The page map and free records of one database file, shared by every connection of the process.
+ */
+struct CompressedFile {
+    mutex fileMutex;
+    int references = 0;
+    uint32_t pageSize = 0;
+    uint32_t pageCount = 0;
+    uint64_t generation = 0;
+    uint64_t sequence = 0;
+    uint64_t syncedSequence = 0;
+    uint32_t salt = 0;
+    // pages were written since the header was
+    bool isHeaderDirty = false;
+    sqlite3_int64 appendOffset = dataStart;
+    vector<PageLocation> pages;
+    // free records by extent size
+    multimap<uint32_t, sqlite3_int64> freeExtents;
+    // records replaced since the last sync, reusable once the records replacing them are synced
+    vector<pair<uint32_t, sqlite3_int64>> pendingFree;
+};
+
+/**
+ * The sqlite3_file of a main database, followed in memory by the sqlite3_file of the wrapped vfs.
+ */
+struct CompressedHandle {
+    sqlite3_file base;
+    sqlite3_file *real;
+    CompressedFile *state;
+    string *path;
+};
+
+}
+
+static mutex filesMutex;
+static unordered_map<string, unique_ptr<CompressedFile>> openFiles;
+static mutex installMutex;
+static bool isInstalled = false;
+static sqlite3_vfs compressVfs;
+static sqlite3_vfs *rootVfs = nullptr;
+
+const char *const MadCompressVfs::name = "madsqlite-lz4";
+
+static uint32_t checksumOf(const void *data, size_t size, uint32_t seed = 0) {
+    // FNV-1a
+    auto bytes = static_cast<const unsigned char *>(data);
+    uint32_t hash = 2166136261U ^ seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * The checksum of the stored bytes of a page, the two accumulators of sqlite's WAL checksum which are far faster than
+ * a byte wise hash.
+ */
+static uint32_t dataChecksumOf(const char *data, size_t size) {
+    uint32_t first = 0;
+    uint32_t second = 0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint32_t words[2];
+        memcpy(words, data + i, sizeof(words));
+        first += words[0] + second;
+        second += words[1] + first;
+    }
+    for (; i < size; ++i) {
+        first += (unsigned char) data[i] + second;
+        second += first;
+    }
+    return first ^ (second * 16777619U) ^ (uint32_t) size;
+}
+
+static uint32_t recordChecksumOf(RecordHeader const &record, uint32_t salt) {
+    return checksumOf(&record, offsetof(RecordHeader, checksum), salt);
+}
+
+static uint32_t roundUp(uint32_t size, uint32_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+//region Page map
+
+static void freeRecord(CompressedFile &file, PageLocation const &location) {
+    if (location.offset) {
+        file.pendingFree.emplace_back(location.extentSize, location.offset);
+    }
+}
+
+static bool readFileHeader(sqlite3_file *real, FileHeader &header) {
+    char buffer[dataStart];
+    sqlite3_int64 size = 0;
+    real->pMethods->xFileSize(real, &size);
+    if (size < dataStart || real->pMethods->xRead(real, buffer, dataStart, 0) != SQLITE_OK) {
+        return false;
+    }
+    bool isValid = false;
+    for (int i = 0; i < 2; ++i) {
+        FileHeader candidate;
+        memcpy(&candidate, buffer + i * headerSpacing, sizeof(candidate));
+        if (memcmp(candidate.magic, fileMagic, sizeof(fileMagic)) != 0 ||
+            candidate.checksum != checksumOf(&candidate, offsetof(FileHeader, checksum))) {
+            continue;
+        }
+        if (!isValid || candidate.generation > header.generation) {
+            header = candidate;
+            isValid = true;
+        }
+    }
+    return isValid;
+}
+
+/**
+ * Whether the stored bytes of a record read back as they were written.
+ */
+static bool isRecordDataValid(sqlite3_file *real, sqlite3_int64 offset, RecordHeader const &record) {
+    static thread_local vector<char> stored;
+    stored.resize(record.storedSize);
+    return real->pMethods->xRead(real, stored.data(), (int) stored.size(),
+                                 offset + (sqlite3_int64) sizeof(RecordHeader)) == SQLITE_OK &&
+           dataChecksumOf(stored.data(), stored.size()) == record.dataChecksum;
+}
+
+/**
+ * Rebuilds the page map from the record headers.
+ *
+ * Records start at multiples of extentAlignment. A torn write leaves an invalid record, the scan resumes at the next
+ * aligned valid record, the torn extent and the records replaced by later ones become free. Records written since the
+ * last completed sync have their stored bytes checked as well, a torn record never replaces the one before it.
+ */
+static int loadLocked(CompressedFile &file, sqlite3_file *real) {
+    sqlite3_int64 size = 0;
+    int rc = real->pMethods->xFileSize(real, &size);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    file.pageSize = 0;
+    file.pageCount = 0;
+    file.generation = 0;
+    file.sequence = 0;
+    file.syncedSequence = 0;
+    file.salt = 0;
+    file.isHeaderDirty = false;
+    file.appendOffset = dataStart;
+    file.pages.clear();
+    file.freeExtents.clear();
+    file.pendingFree.clear();
+    if (size == 0) {
+        return SQLITE_OK;
+    }
+    FileHeader header;
+    if (!readFileHeader(real, header)) {
+        char format[16];
+        if (real->pMethods->xRead(real, format, sizeof(format), 0) == SQLITE_OK &&
+            memcmp(format, "SQLite format 3", sizeof(format)) == 0) {
+            // an uncompressed database
+            return SQLITE_NOTADB;
+        }
+        // created by another connection which has yet to sync it, read again once it has
+        return SQLITE_OK;
+    }
+    file.pageSize = header.pageSize;
+    file.pageCount = header.pageCount;
+    file.generation = header.generation;
+    file.sequence = header.sequence;
+    file.syncedSequence = header.syncedSequence;
+    file.salt = header.salt;
+    file.pages.resize(file.pageCount);
+
+    sqlite3_int64 offset = dataStart;
+    // the end of the last valid record, where the torn extent following it starts
+    sqlite3_int64 validEnd = dataStart;
+    while (offset + (sqlite3_int64) sizeof(RecordHeader) <= size) {
+        RecordHeader record;
+        if (real->pMethods->xRead(real, &record, sizeof(record), offset) != SQLITE_OK ||
+            memcmp(record.magic, recordMagic, sizeof(recordMagic)) != 0 ||
+            record.checksum != recordChecksumOf(record, file.salt) || record.extentSize == 0 ||
+            record.extentSize % extentAlignment != 0 || sizeof(RecordHeader) + record.storedSize > record.extentSize) {
+            offset += extentAlignment;
+            continue;
+        }
+        if (validEnd < offset) {
+            file.freeExtents.emplace((uint32_t) (offset - validEnd), validEnd);
+        }
+        PageLocation location;
+        location.offset = offset;
+        location.storedSize = record.storedSize;
+        location.extentSize = record.extentSize;
+        location.sequence = record.sequence;
+        location.dataChecksum = record.dataChecksum;
+        location.isCompressed = (record.flags & compressedFlag) != 0;
+        file.sequence = max(file.sequence, record.sequence + 1);
+        bool isValid = record.sequence < file.syncedSequence || isRecordDataValid(real, offset, record);
+        if (isValid && record.pageNumber < file.pageCount &&
+            file.pages[record.pageNumber].sequence < record.sequence) {
+            swap(file.pages[record.pageNumber], location);
+        }
+        if (location.offset) {
+            file.freeExtents.emplace(location.extentSize, location.offset);
+        }
+        offset += record.extentSize;
+        validEnd = offset;
+    }
+    // anything following the last valid record is a torn append
+    file.appendOffset = validEnd;
+    return SQLITE_OK;
+}
+
+/**
+ * Rebuilds the page map when another process has written the header since this one last read or wrote it.
+ */
+static int refreshLocked(CompressedFile &file, sqlite3_file *real) {
+    FileHeader header;
+    if (readFileHeader(real, header) && header.generation != file.generation) {
+        return loadLocked(file, real);
+    }
+    return SQLITE_OK;
+}
+
+static int readPageLocked(CompressedFile &file, sqlite3_file *real, uint32_t pageNumber, char *page) {
+    if (pageNumber >= file.pages.size() || !file.pages[pageNumber].offset) {
+        memset(page, 0, file.pageSize);
+        return SQLITE_OK;
+    }
+    auto &location = file.pages[pageNumber];
+    auto dataOffset = location.offset + (sqlite3_int64) sizeof(RecordHeader);
+    if (!location.isCompressed) {
+        int rc = real->pMethods->xRead(real, page, file.pageSize, dataOffset);
+        if (rc == SQLITE_OK && dataChecksumOf(page, file.pageSize) != location.dataChecksum) {
+            return SQLITE_CORRUPT;
+        }
+        return rc;
+    }
+    static thread_local vector<char> stored;
+    stored.resize(location.storedSize);
+    int rc = real->pMethods->xRead(real, stored.data(), (int) stored.size(), dataOffset);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (dataChecksumOf(stored.data(), stored.size()) != location.dataChecksum ||
+        MadLz4::decompress(stored.data(), (int) stored.size(), page, file.pageSize) != (int) file.pageSize) {
+        return SQLITE_CORRUPT;
+    }
+    return SQLITE_OK;
+}
+
+static int writePageLocked(CompressedFile &file, sqlite3_file *real, uint32_t pageNumber, const char *page) {
+    vector<char> record(sizeof(RecordHeader) + MadLz4::compressBound(file.pageSize));
+    RecordHeader header;
+    memcpy(header.magic, recordMagic, sizeof(recordMagic));
+    header.pageNumber = pageNumber;
+    // pages saving less than an eighth are stored as they are
+    int compressedSize = MadLz4::compress(page, file.pageSize, record.data() + sizeof(RecordHeader),
+                                          file.pageSize - file.pageSize / 8);
+    if (compressedSize > 0) {
+        header.storedSize = (uint32_t) compressedSize;
+        header.flags = compressedFlag;
+    } else {
+        memcpy(record.data() + sizeof(RecordHeader), page, file.pageSize);
+        header.storedSize = file.pageSize;
+        header.flags = 0;
+    }
+
+    uint32_t needed = roundUp((uint32_t) sizeof(RecordHeader) + header.storedSize, extentAlignment);
+    sqlite3_int64 offset;
+    auto itr = file.freeExtents.lower_bound(needed);
+    if (itr != file.freeExtents.end() && itr->first <= needed * 2) {
+        header.extentSize = itr->first;
+        offset = itr->second;
+        file.freeExtents.erase(itr);
+    } else {
+        header.extentSize = needed;
+        offset = file.appendOffset;
+        file.appendOffset += needed;
+    }
+    header.sequence = file.sequence++;
+    header.dataChecksum = dataChecksumOf(record.data() + sizeof(RecordHeader), header.storedSize);
+    header.reserved = 0;
+    header.checksum = recordChecksumOf(header, file.salt);
+    memcpy(record.data(), &header, sizeof(header));
+
+    int rc = real->pMethods->xWrite(real, record.data(), (int) (sizeof(RecordHeader) + header.storedSize), offset);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (pageNumber >= file.pages.size()) {
+        file.pages.resize(pageNumber + 1);
+    }
+    auto &location = file.pages[pageNumber];
+    freeRecord(file, location);
+    location.offset = offset;
+    location.storedSize = header.storedSize;
+    location.extentSize = header.extentSize;
+    location.sequence = header.sequence;
+    location.dataChecksum = header.dataChecksum;
+    location.isCompressed = (header.flags & compressedFlag) != 0;
+    file.pageCount = max(file.pageCount, pageNumber + 1);
+    file.isHeaderDirty = true;
+    return SQLITE_OK;
+}
+
+static int writeFileHeaderLocked(CompressedFile &file, sqlite3_file *real) {
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.pageSize = file.pageSize;
+    header.pageCount = file.pageCount;
+    header.generation = ++file.generation;
+    header.sequence = file.sequence;
+    header.syncedSequence = file.syncedSequence;
+    header.salt = file.salt;
+    header.checksum = checksumOf(&header, offsetof(FileHeader, checksum));
+    file.isHeaderDirty = false;
+    // the headers alternate so that a torn header leaves the previous one intact
+    return real->pMethods->xWrite(real, &header, sizeof(header), (sqlite3_int64) (header.generation % 2) * headerSpacing);
+}
+
+//endregion
+
+//region sqlite3_io_methods
+
+static CompressedHandle &handleOf(sqlite3_file *file) {
+    return *reinterpret_cast<CompressedHandle *>(file);
+}
+
+static int compressedClose(sqlite3_file *file) {
+    auto &handle = handleOf(file);
+    int rc = handle.real->pMethods->xClose(handle.real);
+    lock_guard<mutex> guard(filesMutex);
+    if (--handle.state->references == 0) {
+        openFiles.erase(*handle.path);
+    }
+    delete handle.path;
+    return rc;
+}
+
+static int compressedRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset) {
+    auto &handle = handleOf(file);
+    auto &state = *handle.state;
+    lock_guard<mutex> guard(state.fileMutex);
+    auto out = static_cast<char *>(buffer);
+    sqlite3_int64 fileSize = (sqlite3_int64) state.pageCount * state.pageSize;
+    if (state.pageSize == 0 || offset >= fileSize) {
+        memset(out, 0, (size_t) amount);
+        return SQLITE_IOERR_SHORT_READ;
+    }
+    vector<char> page;
+    sqlite3_int64 position = offset;
+    sqlite3_int64 end = min(offset + amount, fileSize);
+    while (position < end) {
+        auto pageNumber = (uint32_t) (position / state.pageSize);
+        sqlite3_int64 pageStart = (sqlite3_int64) pageNumber * state.pageSize;
+        auto length = (size_t) (min(end, pageStart + state.pageSize) - position);
+        char *target = out + (position - offset);
+        int rc;
+        if (position == pageStart && length == state.pageSize) {
+            rc = readPageLocked(state, handle.real, pageNumber, target);
+        } else {
+            page.resize(state.pageSize);
+            rc = readPageLocked(state, handle.real, pageNumber, page.data());
+            memcpy(target, page.data() + (position - pageStart), length);
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        position += length;
+    }
+    if (end < offset + amount) {
+        memset(out + (end - offset), 0, (size_t) (offset + amount - end));
+        return SQLITE_IOERR_SHORT_READ;
+    }
+    return SQLITE_OK;
+}
+
+static int compressedWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset) {
+    auto &handle = handleOf(file);
+    auto &state = *handle.state;
+    lock_guard<mutex> guard(state.fileMutex);
+    if (state.pageSize == 0) {
+        // the first write of a database is a whole page
+        state.pageSize = (amount >= 512 && amount <= 65536 && (amount & (amount - 1)) == 0) ? (uint32_t) amount : 4096;
+        sqlite3_randomness(sizeof(state.salt), &state.salt);
+    }
+    auto in = static_cast<const char *>(buffer);
+    vector<char> page;
+    sqlite3_int64 position = offset;
+    sqlite3_int64 end = offset + amount;
+    while (position < end) {
+        auto pageNumber = (uint32_t) (position / state.pageSize);
+        sqlite3_int64 pageStart = (sqlite3_int64) pageNumber * state.pageSize;
+        auto length = (size_t) (min(end, pageStart + state.pageSize) - position);
+        const char *source = in + (position - offset);
+        int rc;
+        if (position == pageStart && length == state.pageSize) {
+            rc = writePageLocked(state, handle.real, pageNumber, source);
+        } else {
+            page.resize(state.pageSize);
+            rc = readPageLocked(state, handle.real, pageNumber, page.data());
+            if (rc == SQLITE_OK) {
+                memcpy(page.data() + (position - pageStart), source, length);
+                rc = writePageLocked(state, handle.real, pageNumber, page.data());
+            }
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        position += length;
+    }
+    return SQLITE_OK;
+}
+
+static int compressedTruncate(sqlite3_file *file, sqlite3_int64 size) {
+    auto &handle = handleOf(file);
+    auto &state = *handle.state;
+    lock_guard<mutex> guard(state.fileMutex);
+    if (state.pageSize == 0) {
+        return SQLITE_OK;
+    }
+    auto pageCount = (uint32_t) ((size + state.pageSize - 1) / state.pageSize);
+    for (auto i = pageCount; i < state.pages.size(); ++i) {
+        freeRecord(state, state.pages[i]);
+    }
+    if (pageCount < state.pages.size()) {
+        state.pages.resize(pageCount);
+    }
+    state.pageCount = min(state.pageCount, pageCount);
+    state.isHeaderDirty = true;
+    return SQLITE_OK;
+}
+
+static int compressedSync(sqlite3_file *file, int flags) {
+    auto &handle = handleOf(file);
+    auto &state = *handle.state;
+    lock_guard<mutex> guard(state.fileMutex);
+    auto sequence = state.sequence;
+    int rc = state.pageSize ? writeFileHeaderLocked(state, handle.real) : SQLITE_OK;
+    if (rc == SQLITE_OK) {
+        rc = handle.real->pMethods->xSync(handle.real, flags);
+    }
+    if (rc == SQLITE_OK) {
+        // written to the header with the next sync or unlock
+        state.syncedSequence = sequence;
+        for (auto &&extent : state.pendingFree) {
+            state.freeExtents.emplace(extent.first, extent.second);
+        }
+        state.pendingFree.clear();
+    }
+    return rc;
+}
+
+static int compressedFileSize(sqlite3_file *file, sqlite3_int64 *size) {
+    auto &state = *handleOf(file).state;
+    lock_guard<mutex> guard(state.fileMutex);
+    *size = (sqlite3_int64) state.pageCount * state.pageSize;
+    return SQLITE_OK;
+}
+
+static int compressedLock(sqlite3_file *file, int lock) {
+    auto &handle = handleOf(file);
+    int rc = handle.real->pMethods->xLock(handle.real, lock);
+    if (rc != SQLITE_OK || lock != SQLITE_LOCK_SHARED) {
+        return rc;
+    }
+    // another process may have changed the file since this one last saw it
+    auto &state = *handle.state;
+    lock_guard<mutex> guard(state.fileMutex);
+    rc = refreshLocked(state, handle.real);
+    if (rc != SQLITE_OK) {
+        handle.real->pMethods->xUnlock(handle.real, SQLITE_LOCK_NONE);
+    }
+    return rc;
+}
+
+/**
+ * Writes the header of pages written since the last sync, with synchronous=OFF sqlite never syncs and the header
+ * tells other processes to rebuild their page map.
+ */
+static int writeDirtyHeader(CompressedHandle &handle) {
+    auto &state = *handle.state;
+    lock_guard<mutex> guard(state.fileMutex);
+    return state.isHeaderDirty && state.pageSize ? writeFileHeaderLocked(state, handle.real) : SQLITE_OK;
+}
+
+static int compressedUnlock(sqlite3_file *file, int lock) {
+    auto &handle = handleOf(file);
+    int rc = writeDirtyHeader(handle);
+    int unlockRc = handle.real->pMethods->xUnlock(handle.real, lock);
+    return rc == SQLITE_OK ? unlockRc : rc;
+}
+
+static int compressedCheckReservedLock(sqlite3_file *file, int *isReserved) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xCheckReservedLock(real, isReserved);
+}
+
+static int compressedFileControl(sqlite3_file *file, int op, void *arg) {
+    if (op == SQLITE_FCNTL_SIZE_HINT || op == SQLITE_FCNTL_CHUNK_SIZE) {
+        // sizes are of the uncompressed database
+        return SQLITE_NOTFOUND;
+    }
+    auto real = handleOf(file).real;
+    return real->pMethods->xFileControl(real, op, arg);
+}
+
+static int compressedSectorSize(sqlite3_file *file) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xSectorSize(real);
+}
+
+static int compressedDeviceCharacteristics(sqlite3_file *file) {
+    auto real = handleOf(file).real;
+    // pages are written as records elsewhere in the file, none of the atomic write guarantees carry over
+    return real->pMethods->xDeviceCharacteristics(real) &
+           ~(SQLITE_IOCAP_ATOMIC | SQLITE_IOCAP_ATOMIC512 | SQLITE_IOCAP_ATOMIC1K | SQLITE_IOCAP_ATOMIC2K |
+             SQLITE_IOCAP_ATOMIC4K | SQLITE_IOCAP_ATOMIC8K | SQLITE_IOCAP_ATOMIC16K | SQLITE_IOCAP_ATOMIC32K |
+             SQLITE_IOCAP_ATOMIC64K | SQLITE_IOCAP_POWERSAFE_OVERWRITE);
+}
+
+static int compressedShmMap(sqlite3_file *file, int region, int regionSize, int isWrite, void volatile **address) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xShmMap(real, region, regionSize, isWrite, address);
+}
+
+static int compressedShmLock(sqlite3_file *file, int offset, int n, int flags) {
+    auto &handle = handleOf(file);
+    // a WAL connection holds its SHARED lock while open, transactions and checkpoints take locks of the WAL index
+    if (flags & SQLITE_SHM_UNLOCK) {
+        int rc = writeDirtyHeader(handle);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    int rc = handle.real->pMethods->xShmLock(handle.real, offset, n, flags);
+    if (rc == SQLITE_OK && (flags & SQLITE_SHM_LOCK)) {
+        auto &state = *handle.state;
+        lock_guard<mutex> guard(state.fileMutex);
+        rc = refreshLocked(state, handle.real);
+        if (rc != SQLITE_OK) {
+            handle.real->pMethods->xShmLock(handle.real, offset, n, (flags & ~SQLITE_SHM_LOCK) | SQLITE_SHM_UNLOCK);
+        }
+    }
+    return rc;
+}
+
+static void compressedShmBarrier(sqlite3_file *file) {
+    auto real = handleOf(file).real;
+    real->pMethods->xShmBarrier(real);
+}
+
+static int compressedShmUnmap(sqlite3_file *file, int deleteFlag) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xShmUnmap(real, deleteFlag);
+}
+
+// version 2, pages can not be memory mapped
+static const sqlite3_io_methods compressedMethods = {
+        2,
+        compressedClose,
+        compressedRead,
+        compressedWrite,
+        compressedTruncate,
+        compressedSync,
+        compressedFileSize,
+        compressedLock,
+        compressedUnlock,
+        compressedCheckReservedLock,
+        compressedFileControl,
+        compressedSectorSize,
+        compressedDeviceCharacteristics,
+        compressedShmMap,
+        compressedShmLock,
+        compressedShmBarrier,
+        compressedShmUnmap,
+        nullptr,
+        nullptr,
+};
+
+//endregion
+
+//region sqlite3_vfs
+
+static int compressedOpen(sqlite3_vfs *, const char *path, sqlite3_file *file, int flags, int *outFlags) {
+    if (!path || !(flags & SQLITE_OPEN_MAIN_DB)) {
+        // journals and temporary files are the files of the wrapped vfs
+        return rootVfs->xOpen(rootVfs, path, file, flags, outFlags);
+    }
+    auto &handle = handleOf(file);
+    handle.base.pMethods = nullptr;
+    handle.real = reinterpret_cast<sqlite3_file *>(&handle + 1);
+    int rc = rootVfs->xOpen(rootVfs, path, handle.real, flags, outFlags);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (handle.real->pMethods->iVersion < 2) {
+        handle.real->pMethods->xClose(handle.real);
+        return SQLITE_CANTOPEN;
+    }
+    lock_guard<mutex> guard(filesMutex);
+    auto &state = openFiles[path];
+    if (!state) {
+        state.reset(new CompressedFile());
+        lock_guard<mutex> fileGuard(state->fileMutex);
+        rc = loadLocked(*state, handle.real);
+        if (rc != SQLITE_OK) {
+            openFiles.erase(path);
+            handle.real->pMethods->xClose(handle.real);
+            return rc;
+        }
+    }
+    ++state->references;
+    handle.state = state.get();
+    handle.path = new string(path);
+    handle.base.pMethods = &compressedMethods;
+    return SQLITE_OK;
+}
+
+//endregion
+
+//region MadCompressVfs
+
+bool MadCompressVfs::ensureInstalled() {
+    lock_guard<mutex> guard(installMutex);
+    if (isInstalled) {
+        return true;
+    }
+    rootVfs = sqlite3_vfs_find(nullptr);
+    if (!rootVfs) {
+        return false;
+    }
+    // everything but opening files is the wrapped vfs
+    compressVfs = *rootVfs;
+    compressVfs.pNext = nullptr;
+    compressVfs.zName = name;
+    compressVfs.szOsFile = (int) sizeof(CompressedHandle) + rootVfs->szOsFile;
+    compressVfs.xOpen = compressedOpen;
+    isInstalled = sqlite3_vfs_register(&compressVfs, 0) == SQLITE_OK;
+    return isInstalled;
+}
+
+//endregion
@@ -0,0 +1,43 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_MADCOMPRESSVFS_HPP
+#define PROJECT_MADCOMPRESSVFS_HPP
+
+namespace madsqlite {
+
+/**
+ * A sqlite vfs wrapping the default vfs which stores each page of a main database file LZ4 compressed.
+ *
+ * The file starts with two alternating headers holding the page size and count, followed by records of one compressed
+ * page each, aligned to 128 bytes and checksummed over their header and stored bytes. A page map from page number to
+ * record is rebuilt from the record headers when the file is opened and kept in memory so that any page is read with a
+ * single read. A torn record is skipped up to the next valid aligned record and never replaces the synced record of
+ * its page. Rewritten pages go to the free record best fitting them or the end of the file, the records they replace
+ * become free once synced.
+ *
+ * Journals and WAL files are not compressed. The page map is shared by the connections of one process. The header is
+ * written on syncs and when a lock of the file or of the WAL index is released, the page map is rebuilt when a lock
+ * is taken and another process has written the header since, so processes share a file with any journal mode and
+ * synchronous setting. Files are in native byte order.
+ */
+class MadCompressVfs {
+
+public:
+
+    /**
+     * The name the vfs is registered with.
+     */
+    static const char *const name;
+
+    /**
+     * Registers the vfs unless it is already registered.
+     */
+    static bool ensureInstalled();
+
+};
+
+}
+
+#endif //PROJECT_MADCOMPRESSVFS_HPP
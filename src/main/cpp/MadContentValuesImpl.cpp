@@ -17,14 +17,24 @@ using namespace std;
 
 MadContentValues::MadContentValues() : impl(new Impl()) {}
 
+MadContentValues::MadContentValues(size_t arenaBytes) : impl(new Impl(arenaBytes)) {}
+
 MadContentValues::~MadContentValues() {}
 
 //endregion
 
 //region MadContentValues::Impl Constructor
 
+// the FNV-1a offset basis
+const size_t MadContentValues::Impl::emptySignature = sizeof(size_t) == 8 ? (size_t) 14695981039346656037ULL :
+                                                      (size_t) 2166136261U;
+
 MadContentValues::Impl::Impl() {}
 
+MadContentValues::Impl::Impl(size_t arenaBytes) : _isArena(true) {
+    _arena.reserve(arenaBytes);
+}
+
 MadContentValues::Impl::~Impl() {}
 
 //endregion
@@ -36,64 +46,79 @@ void MadContentValues::clear() {
 }
 
 void MadContentValues::putInteger(string const &key, sqlite3_int64 value) {
-    MadContentValues::Impl::Data d = {value};
-    impl->putData(key, d);
+    impl->putData(key).setInteger(value);
 }
 
 void MadContentValues::putReal(string const &key, double value) {
-    MadContentValues::Impl::Data d = {value};
-    impl->putData(key, d);
+    impl->putData(key).setReal(value);
 }
 
 void MadContentValues::putString(string const &key, string const &value) {
-    MadContentValues::Impl::Data d = {value};
-    impl->putData(key, d);
+    auto &data = impl->putData(key);
+    impl->setBytes(data, Impl::TEXT, value.data(), value.size());
 }
 
 void MadContentValues::putBlob(string const &key, vector<unsigned char> const &value) {
-    MadContentValues::Impl::Data d = {value};
-    impl->putData(key, d);
+    auto &data = impl->putData(key);
+    impl->setBytes(data, Impl::BLOB, value.data(), value.size());
 }
 
 void MadContentValues::putBlob(string const &key, const void *blob, size_t sz) {
-    unsigned char *charBuf = (unsigned char *) blob;
-    vector<unsigned char> value(charBuf, charBuf + sz);
-    MadContentValues::Impl::Data d = {value};
-    impl->putData(key, d);
+    auto &data = impl->putData(key);
+    impl->setBytes(data, Impl::BLOB, blob, sz);
 }
 
 //endregion
 
 //region MadContentValues::Impl Methods
 
-const vector<string> MadContentValues::Impl::keys() const {
-    return vector<string>(_keys.begin(), _keys.end());
+MadContentValues::Impl::Entries MadContentValues::Impl::entries() const {
+    return Entries{_entries.data(), _size};
 }
 
-bool MadContentValues::Impl::isEmpty() {
-    return _keys.size() <= 0;
+size_t MadContentValues::Impl::signature() const {
+    return _signature;
 }
 
-bool MadContentValues::Impl::containsKey(string const &key) {
-    return _keys.find(key) != _keys.end();
+bool MadContentValues::Impl::isEmpty() const {
+    return _size == 0;
 }
 
-MadContentValues::Impl::SqlDataType MadContentValues::Impl::typeForKey(std::string const &key) {
-    if (containsKey(key)) {
-        return getData(key).dataType;
+size_t MadContentValues::Impl::byteSize() const {
+    size_t size = 0;
+    for (auto &entry : entries()) {
+        size += entry.key.size();
+        switch (entry.data.dataType) {
+            case TEXT:
+            case BLOB:
+                size += bytesSize(entry.data);
+                break;
+            default:
+                size += sizeof(sqlite3_int64);
+                break;
+        }
     }
-    return SqlDataType::NONE;
+    return size;
+}
+
+bool MadContentValues::Impl::containsKey(string const &key) const {
+    return findData(key) != nullptr;
+}
+
+MadContentValues::Impl::SqlDataType MadContentValues::Impl::typeForKey(std::string const &key) const {
+    auto data = findData(key);
+    return data ? data->dataType : SqlDataType::NONE;
 }
 
 void MadContentValues::Impl::clear() {
-    _keys.clear();
-    _values.clear();
-    _dataMap.clear();
+    _size = 0;
+    _arena.clear();
+    _signature = emptySignature;
 }
 
-long long int MadContentValues::Impl::getAsInteger(string const &key) {
-    if (containsKey(key)) {
-        const Data &data = getData(key);
+long long int MadContentValues::Impl::getAsInteger(string const &key) const {
+    if (auto found = findData(key)) {
+        const Data &data = *found;
         switch (data.dataType) {
             case INT:
                 return data.dataInt;
@@ -101,13 +126,13 @@ long long int MadContentValues::Impl::getAsInteger(string const &key) {
                 return (sqlite3_int64) data.dataReal;
             case TEXT: {
 #ifdef ANDROID
-                return stringToInt(data.dataText);
+                return stringToInt(string(bytes(data), bytesSize(data)));
 #else
-                return stoi(data.dataText);
+                return stoi(string(bytes(data), bytesSize(data)));
 #endif
             }
             case BLOB:
-                return ntohs(*reinterpret_cast<const sqlite3_int64 *>(&data.dataBlob[0]));
+                return ntohs(*reinterpret_cast<const sqlite3_int64 *>(bytes(data)));
             case NONE:
             default:
                 break;
@@ -116,9 +141,9 @@ long long int MadContentValues::Impl::getAsInteger(string const &key) {
     return 0;
 }
 
-double MadContentValues::Impl::getAsReal(string const &key) {
-    if (containsKey(key)) {
-        const Data &data = getData(key);
+double MadContentValues::Impl::getAsReal(string const &key) const {
+    if (auto found = findData(key)) {
+        const Data &data = *found;
         switch (data.dataType) {
             case INT:
                 return data.dataInt;
@@ -126,13 +151,13 @@ double MadContentValues::Impl::getAsReal(string const &key) {
                 return data.dataReal;
             case TEXT: {
 #ifdef ANDROID
-                return stringToDouble(data.dataText);
+                return stringToDouble(string(bytes(data), bytesSize(data)));
 #else
-                return stod(data.dataText);
+                return stod(string(bytes(data), bytesSize(data)));
 #endif
             }
             case BLOB:
-                return ntohs(*reinterpret_cast<const double *>(&data.dataBlob[0]));
+                return ntohs(*reinterpret_cast<const double *>(bytes(data)));
             case NONE:
             default:
                 break;
@@ -141,9 +166,9 @@ double MadContentValues::Impl::getAsReal(string const &key) {
     return 0;
 }
 
-string MadContentValues::Impl::getAsText(string const &key) {
-    if (containsKey(key)) {
-        const Data &data = getData(key);
+string MadContentValues::Impl::getAsText(string const &key) const {
+    if (auto found = findData(key)) {
+        const Data &data = *found;
         switch (data.dataType) {
             case INT:
 #ifdef ANDROID
@@ -158,9 +183,8 @@ string MadContentValues::Impl::getAsText(string const &key) {
                 return to_string(data.dataReal);
 #endif
             case TEXT:
-                return data.dataText;
             case BLOB:
-                return string(data.dataBlob.begin(), data.dataBlob.end());
+                return string(bytes(data), bytesSize(data));
             case NONE:
             default:
                 break;
@@ -169,37 +193,77 @@ string MadContentValues::Impl::getAsText(string const &key) {
     return string();
 }
 
-vector<unsigned char> MadContentValues::Impl::getAsBlob(string const &key) {
-    if (containsKey(key)) {
-        return getData(key).dataBlob;
+vector<unsigned char> MadContentValues::Impl::getAsBlob(string const &key) const {
+    if (auto data = findData(key)) {
+        auto first = reinterpret_cast<const unsigned char *>(bytes(*data));
+        return vector<unsigned char>(first, first + bytesSize(*data));
     }
     return vector<unsigned char>();
 }
 
-void MadContentValues::Impl::putData(string const &key, MadContentValues::Impl::Data &data) {
-    if (containsKey(key)) {
-        long i = _dataMap.at(key);
-        _values[i] = data;
+MadContentValues::Impl::Data &MadContentValues::Impl::putData(string const &key) {
+    for (size_t i = 0; i < _size; ++i) {
+        if (_entries[i].key == key) {
+            return _entries[i].data;
+        }
+    }
+    // reuses the key and bytes of an entry of before the last clear, a row like the last allocates nothing
+    if (_size == _entries.size()) {
+        _entries.emplace_back();
+    }
+    auto &entry = _entries[_size++];
+    entry.key.assign(key);
+    entry.data.dataType = NONE;
+    entry.data.dataBytes.clear();
+    entry.data.isInArena = false;
+    // FNV-1a of the keys, each terminated by a zero byte
+    const size_t prime = sizeof(size_t) == 8 ? (size_t) 1099511628211ULL : (size_t) 16777619U;
+    for (char c : key) {
+        _signature = (_signature ^ (unsigned char) c) * prime;
+    }
+    _signature *= prime;
+    return entry.data;
+}
+
+const MadContentValues::Impl::Data *MadContentValues::Impl::findData(string const &key) const {
+    for (auto &entry : entries()) {
+        if (entry.key == key) {
+            return &entry.data;
+        }
+    }
+    return nullptr;
+}
+
+void MadContentValues::Impl::setBytes(Data &data, SqlDataType dataType, const void *value, size_t sz) {
+    data.dataType = dataType;
+    if (_isArena) {
+        // a replaced value stays in the arena until the clear
+        data.isInArena = true;
+        data.arenaOffset = _arena.size();
+        data.arenaSize = sz;
+        data.dataBytes.clear();
+        _arena.append(reinterpret_cast<const char *>(value), sz);
     } else {
-        long i = _values.size();
-        _values.emplace_back(data);
-        _dataMap.emplace(key, i);
+        data.isInArena = false;
+        data.dataBytes.assign(reinterpret_cast<const char *>(value), sz);
     }
-    _keys.emplace(key);
 }
 
-MadContentValues::Impl::Data MadContentValues::Impl::getData(string const &key) {
-    long i = _dataMap.at(key);
-    return _values[i];
+const char *MadContentValues::Impl::bytes(Data const &data) const {
+    return data.isInArena ? _arena.data() + data.arenaOffset : data.dataBytes.data();
+}
+
+size_t MadContentValues::Impl::bytesSize(Data const &data) const {
+    return data.isInArena ? data.arenaSize : data.dataBytes.size();
 }
 
-double MadContentValues::Impl::stringToDouble(string const &str) {
+double MadContentValues::Impl::stringToDouble(string const &str) const {
     stringstream ss(str);
     double result;
     return ss >> result ? result : 0;
 }
 
-long long int MadContentValues::Impl::stringToInt(string const &str) {
+long long int MadContentValues::Impl::stringToInt(string const &str) const {
     stringstream ss(str);
     long long int result;
     return ss >> result ? result : 0;
@@ -207,7 +271,7 @@ long long int MadContentValues::Impl::stringToInt(string const &str) {
 
 template<typename T>
 string
-MadContentValues::Impl::numberToString(T number) {
+MadContentValues::Impl::numberToString(T number) const {
     stringstream ss;
     ss << number;
     return ss.str();
@@ -8,8 +8,6 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
 #include "MadContentValues.hpp"
 #include "sqlite3.h"
 
@@ -26,40 +24,90 @@ public:
         BLOB,
     };
 
+    /**
+     * A value tagged with its type, text and blobs share the bytes, either their own or a range of the arena.
+     */
     struct Data {
-        SqlDataType dataType;
-        std::vector<unsigned char> dataBlob;
-        double dataReal;
-        long long int dataInt;
-        std::string dataText;
-
-        Data() {
+        SqlDataType dataType = NONE;
+        union {
+            long long int dataInt;
+            double dataReal;
         };
+        std::string dataBytes;
+        bool isInArena = false;
+        size_t arenaOffset = 0;
+        size_t arenaSize = 0;
 
-        Data(const std::vector<unsigned char> &dataBlob) : dataBlob(dataBlob) {
-            dataType = SqlDataType::BLOB;
+        Data() : dataInt(0) {
         };
 
-        Data(const double dataReal) : dataReal(dataReal) {
+        void setInteger(long long int value) {
+            dataType = SqlDataType::INT;
+            dataInt = value;
+            dataBytes.clear();
+            isInArena = false;
+        }
+
+        void setReal(double value) {
             dataType = SqlDataType::REAL;
-        };
+            dataReal = value;
+            dataBytes.clear();
+            isInArena = false;
+        }
+    };
 
-        Data(const sqlite3_int64 dataInt) : dataInt(dataInt) {
-            dataType = SqlDataType::INT;
-        };
+    struct Entry {
+        std::string key;
+        Data data;
+    };
 
-        Data(const std::string &dataText) : dataText(dataText) {
-            dataType = SqlDataType::TEXT;
-        };
+    /**
+     * The entries of the values put since the last clear.
+     */
+    struct Entries {
+        const Entry *first;
+        size_t count;
+
+        const Entry *begin() const {
+            return first;
+        }
+
+        const Entry *end() const {
+            return first + count;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        const Entry &operator[](size_t i) const {
+            return first[i];
+        }
     };
 
 //region Members
 
 public:
 
-    std::unordered_set<std::string> _keys;
-    std::vector<Data> _values;
-    std::unordered_map<std::string, long> _dataMap;
+    /**
+     * The values in the order their keys were first put, a handful per row so lookups scan. The first _size entries
+     * are set, clear keeps the others with their memory for the next values.
+     */
+    std::vector<Entry> _entries;
+    size_t _size = 0;
+
+    /**
+     * The bytes of the text and blob values when the values use an arena.
+     */
+    bool _isArena = false;
+    std::string _arena;
+
+    /**
+     * A hash of the keys in their order, updated as keys are added.
+     */
+    size_t _signature = emptySignature;
+
+    static const size_t emptySignature;
 
 //endregion
 
@@ -70,6 +118,8 @@ public:
 
     Impl();
 
+    explicit Impl(size_t arenaBytes);
+
     virtual ~Impl();
 
 //endregion
@@ -78,34 +128,53 @@ public:
 
 public:
 
-    const std::vector<std::string> keys() const;
+    Entries entries() const;
 
-    bool isEmpty();
+    /**
+     * @return a hash of the keys in the order they were first put, equal for values inserted by the same statement.
+     */
+    size_t signature() const;
 
-    bool containsKey(std::string const &key);
+    bool isEmpty() const;
 
-    SqlDataType typeForKey(std::string const &key);
+    size_t byteSize() const;
+
+    bool containsKey(std::string const &key) const;
+
+    SqlDataType typeForKey(std::string const &key) const;
 
     void clear();
 
-    long long int getAsInteger(std::string const &key);
+    long long int getAsInteger(std::string const &key) const;
+
+    double getAsReal(std::string const &key) const;
+
+    std::string getAsText(std::string const &key) const;
+
+    std::vector<unsigned char> getAsBlob(std::string const &key) const;
 
-    double getAsReal(std::string const &key);
+    /**
+     * @return the value of the key to assign in place, added as NONE if the key is new.
+     */
+    Data &putData(std::string const &key);
 
-    std::string getAsText(std::string const &key);
+    /**
+     * @return the value of the key or null.
+     */
+    const Data *findData(std::string const &key) const;
 
-    std::vector<unsigned char> getAsBlob(std::string const &key);
+    void setBytes(Data &data, SqlDataType dataType, const void *value, size_t sz);
 
-    void putData(std::string const &key, Data &data);
+    const char *bytes(Data const &data) const;
 
-    Data getData(std::string const &key);
+    size_t bytesSize(Data const &data) const;
 
-    double stringToDouble(std::string const &str);
+    double stringToDouble(std::string const &str) const;
 
-    long long int stringToInt(std::string const &str);
+    long long int stringToInt(std::string const &str) const;
 
     template<typename T>
-    std::string numberToString(T number);
+    std::string numberToString(T number) const;
 
 //endregion
 
@@ -7,15 +7,119 @@
 #include "MadDatabaseImpl.hpp"
 #include "MadUtil.hpp"
 #include "MadContentValuesImpl.hpp"
+#include "MadAllocator.hpp"
+#include "MadCompressVfs.hpp"
+#include "MadPageCache.hpp"
+#include "MadUringVfs.hpp"
+#include "MadVfs.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
 
 using namespace madsqlite;
 using namespace std;
 
-static mutex databaseMutex;
-static unordered_map<string, weak_ptr<MadDatabase>> databaseSet;
+namespace {
+
+/**
+ * A slice of the registry of open databases. Databases are spread across shards by file key so that opening
+ * different databases does not contend on one lock, and lookups of open databases share their shard's lock.
+ */
+struct RegistryShard {
+    shared_timed_mutex shardMutex;
+    unordered_map<FileKey, weak_ptr<MadDatabase>, FileKeyHash> databases;
+};
+
+}
+
+static const size_t registryShardCount = 16;
+static RegistryShard databaseRegistry[registryShardCount];
+
+// every database not yet closed, including the in memory ones the registry does not hold. sqlite is shut down to
+// install an allocator or page cache, which must not happen under an open connection.
+static mutex openDatabasesMutex;
+static int openDatabases = 0;
+
+static RegistryShard &registryShard(FileKey const &key) {
+    return databaseRegistry[FileKeyHash()(key) % registryShardCount];
+}
+
+static string pragmaStatement(const char *name, long long value) {
+    char *sql = sqlite3_mprintf("PRAGMA %s=%lld", name, value);
+    string statement(sql);
+    sqlite3_free(sql);
+    return statement;
+}
+
+static string uriPath(string const &path) {
+    string uri;
+    for (char c : path) {
+        if (c == '%' || c == '?' || c == '#') {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02X", (unsigned char) c);
+            uri += escaped;
+        } else {
+            uri += c;
+        }
+    }
+    return uri;
+}
+
+/**
+ * @return the page size of the main database of the connection, or 0 if it could not be read.
+ */
+static int pageSizeOf(sqlite3 *connection) {
+    sqlite3_stmt *stmt = nullptr;
+    int pageSize = 0;
+    if (sqlite3_prepare_v2(connection, "PRAGMA page_size", -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        pageSize = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return pageSize;
+}
+
+static void readAhead(string const &path, int threadCount) {
+    ifstream probe(path, ios::binary | ios::ate);
+    if (!probe || threadCount <= 0) {
+        return;
+    }
+    long long size = probe.tellg();
+    long long sliceSize = (size + threadCount - 1) / threadCount;
+    vector<thread> threads;
+    for (int i = 0; i < threadCount && i * sliceSize < size; ++i) {
+        threads.emplace_back([=]() {
+            ifstream file(path, ios::binary);
+            file.seekg(i * sliceSize);
+            vector<char> buffer(1024 * 1024);
+            long long remaining = min(sliceSize, size - i * sliceSize);
+            while (remaining > 0 && file.read(buffer.data(), min((long long) buffer.size(), remaining))) {
+                remaining -= file.gcount();
+            }
+        });
+    }
+    for (auto &&t : threads) {
+        t.join();
+    }
+}
+
+static const char *beginStatement(MadDatabase::TransactionMode mode) {
+    switch (mode) {
+        case MadDatabase::TransactionMode::IMMEDIATE:
+            return "BEGIN IMMEDIATE";
+        case MadDatabase::TransactionMode::EXCLUSIVE:
+            return "BEGIN EXCLUSIVE";
+        case MadDatabase::TransactionMode::DEFERRED:
+        default:
+            return "BEGIN";
+    }
+}
 
 //region MadDatabase Constructor
 
@@ -29,54 +133,258 @@ MadDatabase::~MadDatabase() {}
 
 //region MadDatabase::Impl Constructor
 
-MadDatabase::Impl::Impl(){
-    sqlite3_open(":memory:", &db);
-}
+MadDatabase::Impl::Impl() : Impl(":memory:", OpenOptions()) {}
+
+MadDatabase::Impl::Impl(string const &dbPath) : Impl(dbPath, OpenOptions()) {}
+
+MadDatabase::Impl::Impl(string const &dbPath, OpenOptions const &options) :
+        groupCommit(bind(&Impl::writeGroup, this, placeholders::_1)) {
+    {
+        lock_guard<mutex> guard(openDatabasesMutex);
+        ++openDatabases;
+    }
+    string filename = dbPath;
+    int flags = options.openFlags ? options.openFlags : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (options.readOnly || options.immutable) {
+        flags = (flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) | SQLITE_OPEN_READONLY;
+    }
+    if (options.immutable) {
+        filename = "file:" + uriPath(dbPath) + "?immutable=1";
+        flags |= SQLITE_OPEN_URI;
+    }
+    isReadOnly = (flags & SQLITE_OPEN_READONLY) != 0;
+    if (options.compressed && MadCompressVfs::ensureInstalled()) {
+        vfsName = MadCompressVfs::name;
+    } else if (options.asyncIo && MadUringVfs::ensureInstalled()) {
+        vfsName = options.directIo ? MadUringVfs::directName : MadUringVfs::name;
+    } else if (options.instrumentedVfs && MadVfs::ensureInstalled()) {
+        vfsName = MadVfs::name;
+    }
+
+    int fileFlags = flags;
+    if (options.preload) {
+        // the file is copied into a shared cache in memory database private to this instance
+        char *memoryUri = sqlite3_mprintf("file:madsqlite-preload-%p?mode=memory&cache=shared", this);
+        filename = memoryUri;
+        sqlite3_free(memoryUri);
+        flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI | SQLITE_OPEN_SHAREDCACHE;
+    }
+    bool isSharedCache = (flags & SQLITE_OPEN_SHAREDCACHE) != 0;
+
+    if (sqlite3_open_v2(filename.c_str(), &db, flags, vfsName) != SQLITE_OK) {
+        return;
+    }
+    // sqlite built or opened without SQLITE_THREADSAFE=1 leaves serializing the use of a connection to the wrapper
+    isSerialized = sqlite3_db_mutex(db) != nullptr;
+    if (options.busyTimeoutMillis > 0) {
+        installBusyHandler(db, busyContext, exponentialBackoff(options.busyTimeoutMillis));
+    }
+    // the page size of a preloaded database is the page size of its file, see preload
+    OpenOptions connectionOptions = options;
+    if (options.preload) {
+        connectionOptions.pageSize = 0;
+    }
+    if (applyOptions(db, connectionOptions) != SQLITE_OK) {
+        return;
+    }
+    if (options.preload) {
+        if (!preload(options.immutable ? "file:" + uriPath(dbPath) + "?immutable=1" : dbPath, fileFlags, options)) {
+            return;
+        }
+        if (!isReadOnly && options.preloadWriteBack != WriteBack::NONE) {
+            preloadPath = dbPath;
+            preloadWriteBack = options.preloadWriteBack;
+            if (preloadWriteBack == WriteBack::PERIODIC) {
+                writeBackTimer = thread(&Impl::runWriteBackTimer, this, options.preloadWriteBackMillis);
+            }
+        }
+    }
+    if (!(isReadOnly || isSharedCache)) {
+        return;
+    }
 
-MadDatabase::Impl::Impl(string const &dbPath) {
-    sqlite3_open(dbPath.c_str(), &db);
+    for (int i = 1; i < options.readerConnections; ++i) {
+        sqlite3 *reader = nullptr;
+        if (sqlite3_open_v2(filename.c_str(), &reader, flags, vfsName) != SQLITE_OK ||
+            applyOptions(reader, connectionOptions) != SQLITE_OK) {
+            sqlite3_close(reader);
+            break;
+        }
+        // readers wait for locks like the writing connection and count in its busy metrics
+        readerBusyContexts.push_back(make_unique<BusyContext>(BusyContext{this, nullptr}));
+        installBusyHandler(reader, *readerBusyContexts.back(), busyContext.handler);
+        if (isReadOnly && options.preload) {
+            sqlite3_exec(reader, "PRAGMA query_only=1", nullptr, nullptr, nullptr);
+        }
+        if (isSharedCache) {
+            // readers of a shared cache do not wait for the table locks of the writer
+            sqlite3_exec(reader, "PRAGMA read_uncommitted=1", nullptr, nullptr, nullptr);
+        }
+        readers.push_back(reader);
+        readerMutexes.push_back(make_unique<mutex>());
+    }
 }
 
 MadDatabase::Impl::~Impl() {
+    {
+        // aborts and waits for backups running in the background
+        unique_lock<mutex> lock(databaseMutex);
+        isClosing = true;
+        writeBackCondition.notify_all();
+        backupCondition.wait(lock, [this]() { return activeBackups == 0; });
+    }
+    if (writeBackTimer.joinable()) {
+        writeBackTimer.join();
+    }
+    // commits any batched inserts and stops the batch timer
+    setAutoBatch(false, autoBatchOptions);
+    if (preloadWriteBack != WriteBack::NONE) {
+        backupTo(preloadPath, -1, 0, nullptr);
+    }
     lock_guard<mutex> guard(databaseMutex);
+    finalizeInsertStatements();
+    for (auto reader : readers) {
+        sqlite3_close(reader);
+    }
     sqlite3_close(db);
-    for (auto itr = databaseSet.begin(); itr != databaseSet.end();) {
-        if (itr->second.expired()) {
-            itr = databaseSet.erase(itr);
-        } else {
-            ++itr;
+    {
+        lock_guard<mutex> openGuard(openDatabasesMutex);
+        --openDatabases;
+    }
+    if (isRegistered) {
+        auto &shard = registryShard(registryKey);
+        lock_guard<shared_timed_mutex> registryGuard(shard.shardMutex);
+        auto itr = shard.databases.find(registryKey);
+        // the entry may already belong to a database opened since this one expired
+        if (itr != shard.databases.end() && itr->second.expired()) {
+            shard.databases.erase(itr);
         }
     }
 }
 
 shared_ptr<MadDatabase> MadDatabase::openDatabase(string const &dbPath) {
-    lock_guard<mutex> guard(databaseMutex);
-    auto absPath = getAbsoluteFilePath(dbPath);
-    if (absPath.length()) {
-        auto itr = databaseSet.find(absPath);
-        if (itr != databaseSet.end()) {
-            if (itr->second.expired()) {
-                databaseSet.erase(itr);
-            } else {
-                return itr->second.lock();
-            }
+    return openDatabase(dbPath, OpenOptions());
+}
+
+shared_ptr<MadDatabase> MadDatabase::openDatabase(string const &dbPath, OpenOptions const &options) {
+    FileKey key;
+    bool isExisting = getFileKey(dbPath, key);
+    if (isExisting) {
+        auto ptr = Impl::findRegistered(key);
+        if (ptr) {
+            return ptr;
         }
     }
 
-    auto imp = make_unique<Impl>(dbPath);
+    // the database is opened outside of the registry lock, the file key of a created database is known afterwards
+    auto imp = make_unique<Impl>(dbPath, options);
     auto err = imp->getError(false);
-    auto ptr = make_shared<MadDatabase>(move(imp));
-    absPath = getAbsoluteFilePath(dbPath);
-    if (absPath.length() && !err.length()) {
-        databaseSet.emplace(getAbsoluteFilePath(dbPath), ptr);
+    if (err.length() || !(isExisting || getFileKey(dbPath, key))) {
+        return make_shared<MadDatabase>(move(imp));
     }
-    return ptr;
+    return Impl::registerDatabase(key, move(imp));
+}
+
+shared_ptr<MadDatabase> MadDatabase::openInMemoryDatabase(string const &name) {
+    return openInMemoryDatabase(name, OpenOptions());
+}
+
+shared_ptr<MadDatabase> MadDatabase::openInMemoryDatabase(string const &name, OpenOptions const &options) {
+    auto uri = "file:" + uriPath(name) + "?mode=memory&cache=shared";
+    FileKey key;
+    key.path = uri;
+    auto ptr = Impl::findRegistered(key);
+    if (ptr) {
+        return ptr;
+    }
+
+    auto memoryOptions = options;
+    memoryOptions.openFlags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI | SQLITE_OPEN_SHAREDCACHE;
+    auto imp = make_unique<Impl>(uri, memoryOptions);
+    if (imp->getError(false).length()) {
+        return make_shared<MadDatabase>(move(imp));
+    }
+    return Impl::registerDatabase(key, move(imp));
 }
 
 unique_ptr<MadDatabase> MadDatabase::openInMemoryDatabase() {
     return make_unique<MadDatabase>(make_unique<Impl>());
 }
 
+unique_ptr<MadDatabase> MadDatabase::openInMemoryDatabase(OpenOptions const &options) {
+    return make_unique<MadDatabase>(make_unique<Impl>(":memory:", options));
+}
+
+bool MadDatabase::installInstrumentedVfs(VfsOptions const &options) {
+    return MadVfs::install(options);
+}
+
+bool MadDatabase::installInstrumentedVfs() {
+    return MadVfs::install(VfsOptions());
+}
+
+map<string, MadDatabase::IoStats> MadDatabase::getIoStats() {
+    return MadVfs::getIoStats();
+}
+
+bool MadDatabase::installArenaPageCache(PageCacheOptions const &options) {
+    // databases opened meanwhile wait for the install
+    lock_guard<mutex> guard(openDatabasesMutex);
+    if (openDatabases > 0) {
+        cout << "Could not install the page cache, databases are open: " << openDatabases << endl;
+        return false;
+    }
+    return MadPageCache::install(options);
+}
+
+MadDatabase::PageCacheStats MadDatabase::getPageCacheStats() {
+    return MadPageCache::getStats();
+}
+
+bool MadDatabase::installAllocator(AllocatorOptions const &options) {
+    // databases opened meanwhile wait for the install
+    lock_guard<mutex> guard(openDatabasesMutex);
+    if (openDatabases > 0) {
+        cout << "Could not install the allocator, databases are open: " << openDatabases << endl;
+        return false;
+    }
+    return MadAllocator::install(options);
+}
+
+MadDatabase::AllocatorStats MadDatabase::getAllocatorStats() {
+    return MadAllocator::getStats();
+}
+
+MadDatabase::BusyHandler MadDatabase::exponentialBackoff(int timeoutMillis, int initialDelayMillis,
+                                                         int maxDelayMillis) {
+    auto const timeout = chrono::microseconds(chrono::milliseconds(timeoutMillis));
+    auto const initialDelay = chrono::microseconds(chrono::milliseconds(max(initialDelayMillis, 1)));
+    auto const maxDelay = max(chrono::microseconds(chrono::milliseconds(maxDelayMillis)), initialDelay);
+    auto start = chrono::steady_clock::now();
+    return [=](int retryCount) mutable -> bool {
+        auto now = chrono::steady_clock::now();
+        if (retryCount == 0) {
+            start = now;
+        }
+        auto remaining = timeout - chrono::duration_cast<chrono::microseconds>(now - start);
+        if (remaining.count() <= 0) {
+            return false;
+        }
+        auto delay = initialDelay;
+        for (int i = 0; i < retryCount && delay < maxDelay; ++i) {
+            delay *= 2;
+        }
+        delay = min(delay, maxDelay);
+
+        // Half of the delay is fixed and half is random so that competing connections spread out their retries.
+        static thread_local minstd_rand random((unsigned int) hash<thread::id>()(this_thread::get_id()));
+        uniform_int_distribution<long long> jitter(0, delay.count() / 2);
+        delay = delay / 2 + chrono::microseconds(jitter(random));
+        this_thread::sleep_for(min(delay, remaining));
+        return true;
+    };
+}
+
 //endregion
 
 //region MadDatabase Methods
@@ -85,16 +393,16 @@ bool MadDatabase::insert(string const &table, MadContentValues &contentValues) {
     return impl->insert(table, contentValues);
 }
 
-void MadDatabase::beginTransaction() {
-    impl->beginTransaction();
+void MadDatabase::beginTransaction(TransactionMode mode) {
+    impl->beginTransaction(mode);
 }
 
 void MadDatabase::rollbackTransaction() {
     impl->rollbackTransaction();
 }
 
-void MadDatabase::commitTransaction() {
-    impl->commitTransaction();
+bool MadDatabase::commitTransaction() {
+    return impl->commitTransaction();
 }
 
 int MadDatabase::exec(string const &sql) {
@@ -102,7 +410,7 @@ int MadDatabase::exec(string const &sql) {
 }
 
 string MadDatabase::getError() {
-    return impl->getError(true);
+    return impl->getLastError();
 }
 
 MadQuery MadDatabase::query(string const &sql, vector<string> const &args) {
@@ -113,29 +421,503 @@ MadQuery MadDatabase::query(string const &sql) {
     return impl->query(sql, {});
 }
 
+void MadDatabase::setBusyTimeout(int milliseconds) {
+    impl->setBusyHandler(milliseconds > 0 ? exponentialBackoff(milliseconds) : nullptr);
+}
+
+void MadDatabase::setBusyHandler(BusyHandler handler) {
+    impl->setBusyHandler(move(handler));
+}
+
+void MadDatabase::setGroupCommit(bool enabled, GroupCommitOptions const &options) {
+    impl->setGroupCommit(enabled, options);
+}
+
+void MadDatabase::setGroupCommit(bool enabled) {
+    impl->setGroupCommit(enabled, GroupCommitOptions());
+}
+
+void MadDatabase::setAutoBatch(bool enabled, AutoBatchOptions const &options) {
+    impl->setAutoBatch(enabled, options);
+}
+
+void MadDatabase::setAutoBatch(bool enabled) {
+    impl->setAutoBatch(enabled, AutoBatchOptions());
+}
+
+bool MadDatabase::flush() {
+    return impl->flush();
+}
+
+MadDatabase::Metrics MadDatabase::getMetrics() {
+    return impl->getMetrics();
+}
+
+bool MadDatabase::backupTo(string const &path, int pagesPerStep, int sleepBetweenStepsMillis,
+                           BackupProgress progress) {
+    return impl->backupTo(path, pagesPerStep, sleepBetweenStepsMillis, progress);
+}
+
+bool MadDatabase::backupTo(MadDatabase &destination, int pagesPerStep, int sleepBetweenStepsMillis,
+                           BackupProgress progress) {
+    return impl->backupTo(*destination.impl, pagesPerStep, sleepBetweenStepsMillis, progress);
+}
+
+future<bool> MadDatabase::backupToAsync(string const &path, int pagesPerStep, int sleepBetweenStepsMillis,
+                                        BackupProgress progress) {
+    return impl->backupToAsync(path, pagesPerStep, sleepBetweenStepsMillis, move(progress));
+}
+
 //endregion
 
 //region MadDatabase::Impl Methods
 
-void MadDatabase::Impl::beginTransaction() {
+shared_ptr<MadDatabase> MadDatabase::Impl::findRegistered(FileKey const &key) {
+    auto &shard = registryShard(key);
+    shared_lock<shared_timed_mutex> registryGuard(shard.shardMutex);
+    auto itr = shard.databases.find(key);
+    if (itr != shard.databases.end()) {
+        return itr->second.lock();
+    }
+    return nullptr;
+}
+
+shared_ptr<MadDatabase> MadDatabase::Impl::registerDatabase(FileKey const &key, unique_ptr<Impl> impl) {
+    auto &shard = registryShard(key);
+    unique_lock<shared_timed_mutex> registryGuard(shard.shardMutex);
+    auto &entry = shard.databases[key];
+    auto ptr = entry.lock();
+    if (ptr) {
+        // another thread opened the same database meanwhile, the given one is closed
+        registryGuard.unlock();
+        return ptr;
+    }
+    impl->isRegistered = true;
+    impl->registryKey = key;
+    ptr = make_shared<MadDatabase>(move(impl));
+    entry = ptr;
+    return ptr;
+}
+
+int MadDatabase::Impl::applyOptions(sqlite3 *connection, OpenOptions const &options) {
+    if (options.lookasideSlotSize > 0 && options.lookasideSlots > 0) {
+        // lookaside memory can only be replaced before the connection has used it
+        sqlite3_db_config(connection, SQLITE_DBCONFIG_LOOKASIDE, nullptr, options.lookasideSlotSize,
+                          options.lookasideSlots);
+    }
+    // page_size must precede anything that writes the database header such as journal_mode=WAL
+    vector<string> pragmas;
+    if (options.pageSize > 0) {
+        pragmas.push_back(pragmaStatement("page_size", options.pageSize));
+    }
+    switch (options.lockingMode) {
+        case LockingMode::NORMAL:
+            pragmas.push_back("PRAGMA locking_mode=NORMAL");
+            break;
+        case LockingMode::EXCLUSIVE:
+            pragmas.push_back("PRAGMA locking_mode=EXCLUSIVE");
+            break;
+        case LockingMode::DEFAULT:
+            break;
+    }
+    switch (options.journalMode) {
+        case JournalMode::DELETE:
+            pragmas.push_back("PRAGMA journal_mode=DELETE");
+            break;
+        case JournalMode::TRUNCATE:
+            pragmas.push_back("PRAGMA journal_mode=TRUNCATE");
+            break;
+        case JournalMode::PERSIST:
+            pragmas.push_back("PRAGMA journal_mode=PERSIST");
+            break;
+        case JournalMode::MEMORY:
+            pragmas.push_back("PRAGMA journal_mode=MEMORY");
+            break;
+        case JournalMode::WAL:
+            pragmas.push_back("PRAGMA journal_mode=WAL");
+            break;
+        case JournalMode::OFF:
+            pragmas.push_back("PRAGMA journal_mode=OFF");
+            break;
+        case JournalMode::DEFAULT:
+            break;
+    }
+    switch (options.synchronous) {
+        case Synchronous::OFF:
+            pragmas.push_back("PRAGMA synchronous=OFF");
+            break;
+        case Synchronous::NORMAL:
+            pragmas.push_back("PRAGMA synchronous=NORMAL");
+            break;
+        case Synchronous::FULL:
+            pragmas.push_back("PRAGMA synchronous=FULL");
+            break;
+        case Synchronous::EXTRA:
+            pragmas.push_back("PRAGMA synchronous=EXTRA");
+            break;
+        case Synchronous::DEFAULT:
+            break;
+    }
+    if (options.cacheSize != 0) {
+        pragmas.push_back(pragmaStatement("cache_size", options.cacheSize));
+    }
+    if (options.mmapSize >= 0) {
+        pragmas.push_back(pragmaStatement("mmap_size", options.mmapSize));
+    }
+    switch (options.tempStore) {
+        case TempStore::FILE:
+            pragmas.push_back("PRAGMA temp_store=FILE");
+            break;
+        case TempStore::MEMORY:
+            pragmas.push_back("PRAGMA temp_store=MEMORY");
+            break;
+        case TempStore::DEFAULT:
+            break;
+    }
+
+    for (auto &pragma : pragmas) {
+        int rc = sqlite3_exec(connection, pragma.c_str(), nullptr, nullptr, nullptr);
+        if (rc != SQLITE_OK) {
+            cout << "Could not apply option: " << pragma << " " << rc << " " << sqlite3_errmsg(connection) << endl;
+            return rc;
+        }
+    }
+    return SQLITE_OK;
+}
+
+void MadDatabase::Impl::beginTransaction(TransactionMode mode) {
+    if (isGroupCommit) {
+        groupCommit.begin();
+        return;
+    }
+    auto lock = lockForCurrentThread();
     if (!isInTransaction) {
-        execInternal("BEGIN");
-        isInTransaction = true;
+        flushLocked();
+        execLocked(beginStatement(mode));
+        // the lock may not have been acquired if the database is busy
+        updateTransactionState();
     }
 }
 
 void MadDatabase::Impl::rollbackTransaction() {
+    if (groupCommit.isOpen()) {
+        groupCommit.rollback();
+        return;
+    }
+    auto lock = lockForCurrentThread();
+    if (isInTransaction) {
+        execLocked("ROLLBACK");
+        updateTransactionState();
+    }
+}
+
+bool MadDatabase::Impl::commitTransaction() {
+    if (groupCommit.isOpen()) {
+        return groupCommit.commit();
+    }
+    auto lock = lockForCurrentThread();
     if (isInTransaction) {
-        execInternal("ROLLBACK");
-        isInTransaction = false;
+        int rc = execLocked("COMMIT");
+        // a busy commit leaves the transaction open so that it may be committed again or rolled back
+        updateTransactionState();
+        return rc == SQLITE_OK;
+    }
+    return false;
+}
+
+unique_lock<mutex> MadDatabase::Impl::lockForCurrentThread() {
+    // every operation on the writing connection takes the lock
+    lastConnection = db;
+    unique_lock<mutex> lock(databaseMutex, try_to_lock);
+    // a transaction belongs to the thread which began it, other threads wait for it to end
+    auto isAvailable = [this]() {
+        return !isInTransaction || transactionOwner == this_thread::get_id();
+    };
+    if (lock.owns_lock() && isAvailable()) {
+        return lock;
+    }
+    auto start = chrono::steady_clock::now();
+    if (!lock.owns_lock()) {
+        lock.lock();
     }
+    transactionCondition.wait(lock, isAvailable);
+    ++lockWaits;
+    lockWaitMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    return lock;
 }
 
-void MadDatabase::Impl::commitTransaction() {
+void MadDatabase::Impl::updateTransactionState() {
+    isInTransaction = sqlite3_get_autocommit(db) == 0;
     if (isInTransaction) {
-        execInternal("COMMIT");
-        isInTransaction = false;
+        transactionOwner = this_thread::get_id();
+    } else {
+        transactionOwner = thread::id();
+        transactionCondition.notify_all();
+    }
+}
+
+void MadDatabase::Impl::setGroupCommit(bool enabled, GroupCommitOptions const &options) {
+    groupCommit.setOptions(options);
+    isGroupCommit = enabled;
+}
+
+void MadDatabase::Impl::setAutoBatch(bool enabled, AutoBatchOptions const &options) {
+    thread stoppedTimer;
+    {
+        lock_guard<mutex> guard(databaseMutex);
+        if (!enabled) {
+            flushLocked();
+        }
+        isAutoBatch = enabled;
+        autoBatchOptions = options;
+        if (!enabled || options.maxDelayMillis <= 0) {
+            stoppedTimer = move(batchTimer);
+        } else if (!batchTimer.joinable()) {
+            batchTimer = thread(&Impl::runBatchTimer, this);
+        }
+        batchCondition.notify_all();
+    }
+    if (stoppedTimer.joinable()) {
+        stoppedTimer.join();
+    }
+}
+
+bool MadDatabase::Impl::flush() {
+    auto lock = lockForCurrentThread();
+    return flushLocked();
+}
+
+bool MadDatabase::Impl::flushLocked() {
+    if (!isBatchOpen) {
+        return true;
+    }
+    int rc = execLocked("COMMIT");
+    // a busy commit leaves the batch open to be committed later
+    isBatchOpen = sqlite3_get_autocommit(db) == 0;
+    if (isBatchOpen) {
+        batchStart = chrono::steady_clock::now();
+    } else {
+        batchRows = 0;
+        batchBytes = 0;
+    }
+    return rc == SQLITE_OK;
+}
+
+void MadDatabase::Impl::runBatchTimer() {
+    unique_lock<mutex> lock(databaseMutex);
+    // the timer stops once it is no longer the current batch timer
+    while (batchTimer.get_id() == this_thread::get_id()) {
+        if (!isBatchOpen) {
+            batchCondition.wait(lock);
+            continue;
+        }
+        auto due = batchStart + chrono::milliseconds(autoBatchOptions.maxDelayMillis);
+        if (chrono::steady_clock::now() >= due) {
+            flushLocked();
+        } else {
+            batchCondition.wait_until(lock, due);
+        }
+    }
+}
+
+bool MadDatabase::Impl::preload(string const &path, int flags, OpenOptions const &options) {
+    readAhead(path, options.preloadReadAheadThreads);
+    sqlite3 *source = nullptr;
+    int rc = sqlite3_open_v2(path.c_str(), &source, flags, vfsName);
+    if (rc == SQLITE_OK && options.pageSize > 0) {
+        // only takes effect when the file is new
+        rc = sqlite3_exec(source, pragmaStatement("page_size", options.pageSize).c_str(), nullptr, nullptr, nullptr);
+    }
+    if (rc == SQLITE_OK) {
+        // a backup into memory fails unless both databases have the same page size
+        int pageSize = pageSizeOf(source);
+        rc = pageSize > 0 ? sqlite3_exec(db, pragmaStatement("page_size", pageSize).c_str(), nullptr, nullptr, nullptr)
+                          : sqlite3_errcode(source);
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_backup *backup = sqlite3_backup_init(db, "main", source, "main");
+        if (backup) {
+            rc = sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        } else {
+            rc = sqlite3_errcode(db);
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        cout << "Could not preload database: " << path << " " << rc << " " << sqlite3_errmsg(source) << endl;
+    }
+    sqlite3_close(source);
+    if (rc == SQLITE_DONE && isReadOnly) {
+        sqlite3_exec(db, "PRAGMA query_only=1", nullptr, nullptr, nullptr);
+    }
+    return rc == SQLITE_DONE;
+}
+
+void MadDatabase::Impl::runWriteBackTimer(long long intervalMillis) {
+    unique_lock<mutex> lock(databaseMutex);
+    while (!isClosing) {
+        writeBackCondition.wait_for(lock, chrono::milliseconds(intervalMillis));
+        if (!isClosing) {
+            lock.unlock();
+            backupTo(preloadPath, 100, 0, [this](int, int) { return !isClosing; });
+            lock.lock();
+        }
+    }
+}
+
+bool MadDatabase::Impl::backupTo(string const &path, int pagesPerStep, int sleepBetweenStepsMillis,
+                                 BackupProgress const &progress) {
+    sqlite3 *destination = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &destination, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfsName) != SQLITE_OK) {
+        cout << "Could not open backup destination: " << sqlite3_errmsg(destination) << endl;
+        sqlite3_close(destination);
+        return false;
+    }
+    bool isComplete = backup(destination, nullptr, pagesPerStep, sleepBetweenStepsMillis, progress);
+    sqlite3_close(destination);
+    return isComplete;
+}
+
+bool MadDatabase::Impl::backupTo(Impl &destination, int pagesPerStep, int sleepBetweenStepsMillis,
+                                 BackupProgress const &progress) {
+    if (&destination == this) {
+        return false;
+    }
+    return backup(destination.db, &destination.databaseMutex, pagesPerStep, sleepBetweenStepsMillis, progress);
+}
+
+future<bool> MadDatabase::Impl::backupToAsync(string const &path, int pagesPerStep, int sleepBetweenStepsMillis,
+                                              BackupProgress progress) {
+    {
+        lock_guard<mutex> guard(databaseMutex);
+        ++activeBackups;
+    }
+    return async(launch::async, [=]() {
+        // closing the database aborts the backup
+        auto abortOnClose = [=](int remainingPages, int totalPages) {
+            return !isClosing && (!progress || progress(remainingPages, totalPages));
+        };
+        bool isComplete = backupTo(path, pagesPerStep, sleepBetweenStepsMillis, abortOnClose);
+        lock_guard<mutex> guard(databaseMutex);
+        --activeBackups;
+        backupCondition.notify_all();
+        return isComplete;
+    });
+}
+
+bool MadDatabase::Impl::backup(sqlite3 *destination, mutex *destinationMutex, int pagesPerStep,
+                               int sleepBetweenStepsMillis, BackupProgress const &progress) {
+    // both connections are locked while the backup uses them
+    auto lockBoth = [&]() {
+        unique_lock<mutex> sourceLock(databaseMutex, defer_lock);
+        unique_lock<mutex> destinationLock;
+        if (destinationMutex) {
+            destinationLock = unique_lock<mutex>(*destinationMutex, defer_lock);
+            lock(sourceLock, destinationLock);
+        } else {
+            sourceLock.lock();
+        }
+        return make_pair(move(sourceLock), move(destinationLock));
+    };
+
+    sqlite3_backup *backup;
+    {
+        auto locks = lockBoth();
+        backup = sqlite3_backup_init(destination, "main", db, "main");
+    }
+    if (!backup) {
+        cout << "Could not start backup: " << sqlite3_errmsg(destination) << endl;
+        return false;
+    }
+
+    int rc;
+    bool isAborted = false;
+    do {
+        {
+            auto locks = lockBoth();
+            // a backup of this connection waits for batched inserts to be committed
+            flushLocked();
+            rc = sqlite3_backup_step(backup, pagesPerStep > 0 ? pagesPerStep : -1);
+        }
+        if (progress && !progress(sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup))) {
+            isAborted = true;
+        }
+        if (rc != SQLITE_DONE && sleepBetweenStepsMillis > 0) {
+            this_thread::sleep_for(chrono::milliseconds(sleepBetweenStepsMillis));
+        }
+    } while (!isAborted && (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
+
+    {
+        auto locks = lockBoth();
+        sqlite3_backup_finish(backup);
+    }
+    if (rc != SQLITE_DONE && !isAborted) {
+        cout << "Could not complete backup: " << rc << " " << sqlite3_errmsg(destination) << endl;
+    }
+    return rc == SQLITE_DONE;
+}
+
+void MadDatabase::Impl::setBusyHandler(BusyHandler handler) {
+    lock_guard<mutex> guard(databaseMutex);
+    installBusyHandler(db, busyContext, handler);
+    for (size_t i = 0; i < readers.size(); ++i) {
+        installBusyHandler(readers[i], *readerBusyContexts[i], handler);
+    }
+}
+
+void MadDatabase::Impl::installBusyHandler(sqlite3 *connection, BusyContext &context, BusyHandler const &handler) {
+    // sqlite calls the handler while the statement waiting holds the connection, the handler is replaced under the
+    // same mutex. The mutex of the writing connection is held by the caller.
+    unique_lock<mutex> lock;
+    auto readerMutex = connection == db ? nullptr : connectionMutex(connection);
+    if (readerMutex) {
+        lock = unique_lock<mutex>(*readerMutex);
+    }
+    sqlite3_mutex_enter(sqlite3_db_mutex(connection));
+    context.handler = handler;
+    if (context.handler) {
+        sqlite3_busy_handler(connection, busyCallback, &context);
+    } else {
+        sqlite3_busy_handler(connection, nullptr, nullptr);
+    }
+    sqlite3_mutex_leave(sqlite3_db_mutex(connection));
+}
+
+int MadDatabase::Impl::busyCallback(void *context, int retryCount) {
+    auto busy = static_cast<BusyContext *>(context);
+    return busy->impl->onBusy(busy->handler, retryCount) ? 1 : 0;
+}
+
+bool MadDatabase::Impl::onBusy(BusyHandler &handler, int retryCount) {
+    auto start = chrono::steady_clock::now();
+    bool retry = handler && handler(retryCount);
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    busyWaitMicros += elapsed.count();
+    if (retry) {
+        ++busyRetries;
+    } else {
+        ++busyTimeouts;
+    }
+    return retry;
+}
+
+MadDatabase::Metrics MadDatabase::Impl::getMetrics() {
+    Metrics metrics;
+    metrics.busyRetries = busyRetries;
+    metrics.busyTimeouts = busyTimeouts;
+    metrics.busyWaitMicros = busyWaitMicros;
+    int current = 0, highwater = 0, missSize = 0, missFull = 0;
+    long long hits = 0;
+    if (sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_HIT, &current, &highwater, 0) == SQLITE_OK) {
+        hits = highwater;
     }
+    sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, &current, &missSize, 0);
+    sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, &current, &missFull, 0);
+    metrics.lookasideHits = hits;
+    metrics.lookasideMisses = (long long) missSize + missFull;
+    metrics.lockWaits = lockWaits;
+    metrics.lockWaitMicros = lockWaitMicros;
+    return metrics;
 }
 
 int MadDatabase::Impl::exec(string const &sql) {
@@ -143,11 +925,23 @@ int MadDatabase::Impl::exec(string const &sql) {
     if (transactionKeyWords.find(upper) != transactionKeyWords.end()) {
         return 0;
     }
+    if (groupCommit.isOpen()) {
+        MadGroupCommit::Operation operation;
+        operation.sql = sql;
+        groupCommit.add(move(operation), sql.size());
+        return 0;
+    }
     return execInternal(sql);
 }
 
 int MadDatabase::Impl::execInternal(string const &sql) {
-    lock_guard<mutex> guard(databaseMutex);
+    auto lock = lockForCurrentThread();
+    flushLocked();
+    execLocked(sql);
+    return sqlite3_changes(db);
+}
+
+int MadDatabase::Impl::execLocked(string const &sql) {
     char *errorMessage = 0;
     int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errorMessage);
     if (rc == SQLITE_OK) {
@@ -160,7 +954,7 @@ int MadDatabase::Impl::execInternal(string const &sql) {
             cout << "exec: " << sql << " " << rc << " " << getError(false) << endl;
         }
     }
-    return sqlite3_changes(db);
+    return rc;
 }
 
 bool MadDatabase::Impl::insert(string const &table, MadContentValues &contentValues) {
@@ -169,18 +963,119 @@ bool MadDatabase::Impl::insert(string const &table, MadContentValues &contentVal
         return false;
     }
 
-    lock_guard<mutex> guard(databaseMutex);
+    if (groupCommit.isOpen()) {
+        MadGroupCommit::Operation operation;
+        operation.table = table;
+        *operation.values.impl = *values;
+        groupCommit.add(move(operation), values->byteSize());
+        return true;
+    }
+
+    auto lock = lockForCurrentThread();
+    if (!isAutoBatch || isInTransaction) {
+        return insertLocked(table, *values);
+    }
+
+    if (!isBatchOpen) {
+        if (execLocked("BEGIN") != SQLITE_OK) {
+            return false;
+        }
+        isBatchOpen = true;
+        batchStart = chrono::steady_clock::now();
+        batchCondition.notify_all();
+    }
+    bool isInserted = insertLocked(table, *values);
+    if (sqlite3_get_autocommit(db) != 0) {
+        // sqlite rolled back the batch in response to the error
+        isBatchOpen = false;
+        batchRows = 0;
+        batchBytes = 0;
+    } else if (isInserted) {
+        batchRows += 1;
+        batchBytes += values->byteSize();
+        if (batchRows >= autoBatchOptions.maxRows || batchBytes >= autoBatchOptions.maxBytes) {
+            flushLocked();
+        }
+    }
+    return isInserted;
+}
+
+bool MadDatabase::Impl::insertLocked(string const &table, MadContentValues::Impl &values) {
+    auto stmt = insertStatement(table, values);
+    if (!stmt) {
+        return false;
+    }
+    auto entries = values.entries();
+    int rc = SQLITE_OK;
+
+    // the statement is reset before the values can change, sqlite need not copy them
+    for (size_t i = 0; i < entries.size() && rc == SQLITE_OK; ++i) {
+        auto &data = entries[i].data;
+        int index = (int) i + 1;
+        switch (data.dataType) {
+            case MadContentValues::Impl::SqlDataType::NONE: {
+                break;
+            }
+            case MadContentValues::Impl::SqlDataType::INT: {
+                rc = sqlite3_bind_int64(stmt, index, data.dataInt);
+                break;
+            }
+            case MadContentValues::Impl::SqlDataType::REAL: {
+                rc = sqlite3_bind_double(stmt, index, data.dataReal);
+                break;
+            }
+            case MadContentValues::Impl::SqlDataType::TEXT: {
+                rc = sqlite3_bind_text(stmt, index, values.bytes(data), (int) values.bytesSize(data), SQLITE_STATIC);
+                break;
+            }
+            case MadContentValues::Impl::SqlDataType::BLOB: {
+                rc = sqlite3_bind_blob(stmt, index, values.bytes(data), (int) values.bytesSize(data), SQLITE_STATIC);
+                break;
+            }
+        }
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_DONE) {
+            cout << "Could not step (execute) stmt." << endl;
+        }
+    } else {
+        cout << "Could not bind statement." << endl;
+    }
+    // the statement is cached, it must not keep the values bound
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return rc == SQLITE_DONE;
+}
+
+sqlite3_stmt *MadDatabase::Impl::insertStatement(string const &table, MadContentValues::Impl const &values) {
+    auto entries = values.entries();
+    size_t key = hash<string>()(table) * 31 + values.signature();
+    auto found = insertStatements.find(key);
+    if (found != insertStatements.end()) {
+        // a hash collision of another table or other keys is replaced below
+        auto &cached = found->second;
+        bool isSame = cached.table == table && cached.columns.size() == entries.size();
+        for (size_t i = 0; isSame && i < entries.size(); ++i) {
+            isSame = cached.columns[i] == entries[i].key;
+        }
+        if (isSame) {
+            return cached.statement;
+        }
+        sqlite3_finalize(cached.statement);
+        insertStatements.erase(found);
+    }
+
     /*
      * INSERT INTO [table] ([row1], [row2]) VALUES (0,"value");
      * INSERT INTO [table] ([?], [?]) VALUES (?,?);
      */
     string sql = "INSERT INTO [" + table + "] (";
     string bindings = " VALUES (";
-    auto keys = values->keys();
-    for (auto key: keys) {
-        sql += "[" + key + "] ";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        sql += "[" + entries[i].key + "] ";
 
-        if (key == keys.back()) {
+        if (i + 1 == entries.size()) {
             sql += ")";
             bindings += "?);";
         } else {
@@ -193,62 +1088,106 @@ bool MadDatabase::Impl::insert(string const &table, MadContentValues &contentVal
     int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
     if (rc != SQLITE_OK) {
         cout << "Could not prepare statement: " << sqlite3_errmsg(db) << endl;
-        return false;
+        return nullptr;
     }
 
-    for (int i = 0; i < keys.size(); ++i) {
-        string key = keys.at((unsigned long) i);
-        switch (values->typeForKey(key)) {
-            case MadContentValues::Impl::SqlDataType::NONE: {
-                break;
-            }
-            case MadContentValues::Impl::SqlDataType::INT: {
-                if (sqlite3_bind_int64(stmt, i + 1, values->getAsInteger(key)) != SQLITE_OK) {
-                    cout << "Could not bind statement." << endl;
-                    return -1;
-                };
-                break;
-            }
-            case MadContentValues::Impl::SqlDataType::REAL: {
-                if (sqlite3_bind_double(stmt, i + 1, values->getAsReal(key)) != SQLITE_OK) {
-                    cout << "Could not bind statement." << endl;
-                    return -1;
-                };
-                break;
+    if (insertStatements.size() >= maxInsertStatements) {
+        finalizeInsertStatements();
+    }
+    auto &cached = insertStatements[key];
+    cached.table = table;
+    cached.columns.reserve(entries.size());
+    for (auto &entry : entries) {
+        cached.columns.push_back(entry.key);
+    }
+    cached.statement = stmt;
+    return stmt;
+}
+
+void MadDatabase::Impl::finalizeInsertStatements() {
+    for (auto &entry : insertStatements) {
+        sqlite3_finalize(entry.second.statement);
+    }
+    insertStatements.clear();
+}
+
+void MadDatabase::Impl::writeGroup(vector<MadGroupCommit::Unit *> &group) {
+    auto lock = lockForCurrentThread();
+    flushLocked();
+    if (execLocked("BEGIN IMMEDIATE") != SQLITE_OK) {
+        return;
+    }
+
+    // Each unit is applied within its own savepoint so that a failing unit does not fail the others.
+    bool isShared = group.size() > 1;
+    for (auto unit : group) {
+        if (isShared) {
+            execLocked("SAVEPOINT group_unit");
+        }
+        bool isApplied = true;
+        for (auto &operation : unit->operations) {
+            if (operation.sql.empty()) {
+                isApplied = insertLocked(operation.table, *operation.values.impl);
+            } else {
+                isApplied = execLocked(operation.sql) == SQLITE_OK;
             }
-            case MadContentValues::Impl::SqlDataType::TEXT: {
-                const string &text = values->getAsText(key);
-                if (sqlite3_bind_text(stmt, i + 1, text.c_str(), (int) text.length(), SQLITE_TRANSIENT) != SQLITE_OK) {
-                    cout << "Could not bind statement." << endl;
-                    return -1;
-                };
+            if (!isApplied) {
                 break;
             }
-            case MadContentValues::Impl::SqlDataType::BLOB: {
-                const vector<unsigned char> vector = values->getAsBlob(key);
-                if (sqlite3_bind_blob(stmt, i + 1, vector.data(), (int) vector.size(), SQLITE_TRANSIENT) != SQLITE_OK) {
-                    cout << "Could not bind statement." << endl;
-                    return -1;
-                };
-                break;
+        }
+        if (isShared) {
+            if (!isApplied) {
+                execLocked("ROLLBACK TO group_unit");
             }
+            execLocked("RELEASE group_unit");
+        } else if (!isApplied) {
+            execLocked("ROLLBACK");
+            return;
         }
+        unit->committed = isApplied;
     }
 
-    // sqlite3_reset(stmt);
+    if (execLocked("COMMIT") != SQLITE_OK) {
+        if (sqlite3_get_autocommit(db) == 0) {
+            execLocked("ROLLBACK");
+        }
+        for (auto unit : group) {
+            unit->committed = false;
+        }
+    }
+}
 
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        cout << "Could not step (execute) stmt." << endl;
-        return false;
+string MadDatabase::Impl::getError(bool doLock) {
+    unique_lock<mutex> lock(databaseMutex, defer_lock);
+    if (doLock) {
+        lock.lock();
     }
+    return errorOf(db);
+}
 
-    return true;
+string MadDatabase::Impl::getLastError() {
+    auto connection = lastConnection.load();
+    if (!connection || connection == db) {
+        return getError(true);
+    }
+    unique_lock<mutex> lock;
+    auto readerMutex = connectionMutex(connection);
+    if (readerMutex) {
+        lock = unique_lock<mutex>(*readerMutex);
+    }
+    return errorOf(connection);
 }
 
-string MadDatabase::Impl::getError(bool doLock) {
-    if (doLock)
-        lock_guard<mutex> guard(databaseMutex);
-    auto err = string(sqlite3_errmsg(db));
+string MadDatabase::Impl::errorOf(sqlite3 *connection) {
+    // queries step outside of the database lock, read the code and message atomically
+    sqlite3_mutex_enter(sqlite3_db_mutex(connection));
+    auto code = sqlite3_errcode(connection);
+    auto err = string(sqlite3_errmsg(connection));
+    sqlite3_mutex_leave(sqlite3_db_mutex(connection));
+    if (code == SQLITE_ROW || code == SQLITE_DONE) {
+        // step results are reported through the error message of newer sqlite versions
+        return "";
+    }
     if (err.compare("not an error") == 0 || err.compare("unknown error") == 0) {
         return "";
     } else {
@@ -257,11 +1196,55 @@ string MadDatabase::Impl::getError(bool doLock) {
 }
 
 MadQuery MadDatabase::Impl::query(string const &sql, vector<string> const &args) {
-    lock_guard<mutex> guard(databaseMutex);
+    if (isReadOnly || !readers.empty()) {
+        // reader connections are never written, their queries need not wait for the database lock
+        auto connection = readerConnection();
+        lastConnection = connection;
+        auto readerMutex = connectionMutex(connection);
+        unique_lock<mutex> lock;
+        if (readerMutex) {
+            lock = unique_lock<mutex>(*readerMutex);
+        }
+        return prepareQuery(connection, sql, args);
+    }
+    auto lock = lockForCurrentThread();
+    if (isAutoBatch && autoBatchOptions.flushOnQuery) {
+        flushLocked();
+    }
+    return prepareQuery(db, sql, args);
+}
+
+sqlite3 *MadDatabase::Impl::readerConnection() {
+    if (!isReadOnly) {
+        return readers[nextReader++ % readers.size()];
+    }
+    if (readers.empty()) {
+        return db;
+    }
+    auto index = nextReader++ % (readers.size() + 1);
+    return index == 0 ? db : readers[index - 1];
+}
+
+mutex *MadDatabase::Impl::connectionMutex(sqlite3 *connection) {
+    if (isSerialized) {
+        return nullptr;
+    }
+    if (connection == db) {
+        return &databaseMutex;
+    }
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (readers[i] == connection) {
+            return readerMutexes[i].get();
+        }
+    }
+    return nullptr;
+}
+
+MadQuery MadDatabase::Impl::prepareQuery(sqlite3 *connection, string const &sql, vector<string> const &args) {
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
+    int rc = sqlite3_prepare_v2(connection, sql.c_str(), -1, &stmt, 0);
     if (rc != SQLITE_OK) {
-        cout << "Could not prepare statement: " << sqlite3_errmsg(db) << endl;
+        cout << "Could not prepare statement: " << sqlite3_errmsg(connection) << endl;
     }
     for (int i = 0; i < args.size(); ++i) {
         const string &str = args.at((unsigned long) i);
@@ -270,7 +1253,7 @@ MadQuery MadDatabase::Impl::query(string const &sql, vector<string> const &args)
             cout << "Could not bind text: " << str << endl;
         }
     }
-    auto impl = make_unique<MadQuery::Impl>(stmt);
+    auto impl = make_unique<MadQuery::Impl>(stmt, connectionMutex(connection));
     return MadQuery(move(impl));
 }
 
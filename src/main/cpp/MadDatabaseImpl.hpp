@@ -8,9 +8,18 @@
 #include "sqlite3.h"
 #include "MadQuery.hpp"
 #include "MadContentValues.hpp"
+#include "MadDatabase.hpp"
+#include "MadContentValuesImpl.hpp"
+#include "MadGroupCommit.hpp"
+#include "MadUtil.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -28,6 +37,8 @@ public:
 
     Impl(std::string const &dbPath);
 
+    Impl(std::string const &dbPath, OpenOptions const &options);
+
     virtual ~Impl();
 
 //endregion
@@ -36,32 +47,167 @@ public:
 
 private:
     sqlite3 *db;
+    std::mutex databaseMutex;
+    bool isRegistered = false;
+    FileKey registryKey;
+    const char *vfsName = nullptr;
+    bool isReadOnly = false;
+    std::vector<sqlite3 *> readers;
+    std::vector<std::unique_ptr<std::mutex>> readerMutexes;
+    bool isSerialized = true;
+    std::atomic<unsigned int> nextReader{0};
     bool isInTransaction = false;
+    std::thread::id transactionOwner;
+    std::condition_variable transactionCondition;
     const std::unordered_set<std::string> transactionKeyWords = {"BEGIN", "COMMIT", "ROLLBACK"};
 
+    /**
+     * The busy handler of one connection. Each connection has its own copy, handlers such as
+     * MadDatabase::exponentialBackoff keep the state of the wait in progress.
+     */
+    struct BusyContext {
+        Impl *impl;
+        BusyHandler handler;
+    };
+
+    BusyContext busyContext{this, nullptr};
+    std::vector<std::unique_ptr<BusyContext>> readerBusyContexts;
+    // the connection of the latest operation, whose error getLastError reports
+    std::atomic<sqlite3 *> lastConnection{nullptr};
+    std::atomic<long long> busyRetries{0};
+    std::atomic<long long> busyTimeouts{0};
+    std::atomic<long long> busyWaitMicros{0};
+    std::atomic<long long> lockWaits{0};
+    std::atomic<long long> lockWaitMicros{0};
+    std::atomic<bool> isGroupCommit{false};
+    MadGroupCommit groupCommit;
+    bool isAutoBatch = false;
+    AutoBatchOptions autoBatchOptions;
+    bool isBatchOpen = false;
+    size_t batchRows = 0;
+    size_t batchBytes = 0;
+    std::chrono::steady_clock::time_point batchStart;
+    std::condition_variable batchCondition;
+    std::thread batchTimer;
+    std::atomic<bool> isClosing{false};
+    std::string preloadPath;
+    WriteBack preloadWriteBack = WriteBack::NONE;
+    std::condition_variable writeBackCondition;
+    std::thread writeBackTimer;
+    int activeBackups = 0;
+    std::condition_variable backupCondition;
+
+    /**
+     * A prepared insert of the columns of a table, reused by inserts of values with the same keys.
+     */
+    struct InsertStatement {
+        std::string table;
+        std::vector<std::string> columns;
+        sqlite3_stmt *statement;
+    };
+
+    /**
+     * The insert statements by the hash of the table and the signature of the values.
+     */
+    std::unordered_map<size_t, InsertStatement> insertStatements;
+    static const size_t maxInsertStatements = 32;
+
 //endregion
 
 //region Methods
 
 public:
 
+    /**
+     * @return the error of the writing connection.
+     */
     std::string getError(bool doLock);
 
+    /**
+     * @return the error of the connection of the latest operation, a reader connection after a query run on it.
+     */
+    std::string getLastError();
+
+    static std::shared_ptr<MadDatabase> findRegistered(FileKey const &key);
+
+    static std::shared_ptr<MadDatabase> registerDatabase(FileKey const &key, std::unique_ptr<Impl> impl);
+
+private:
+
+    static int busyCallback(void *context, int retryCount);
+
+    bool onBusy(BusyHandler &handler, int retryCount);
+
+    void installBusyHandler(sqlite3 *connection, BusyContext &context, BusyHandler const &handler);
+
+    static std::string errorOf(sqlite3 *connection);
+
 private:
 
+    static int applyOptions(sqlite3 *connection, OpenOptions const &options);
+
+    sqlite3 *readerConnection();
+
+    std::mutex *connectionMutex(sqlite3 *connection);
+
+    MadQuery prepareQuery(sqlite3 *connection, std::string const &sql, std::vector<std::string> const &args);
+
+    std::unique_lock<std::mutex> lockForCurrentThread();
+
+    void updateTransactionState();
+
     int execInternal(std::string const &sql);
 
+    int execLocked(std::string const &sql);
+
     bool insert(std::string const &table, MadContentValues &contentValues);
 
+    bool insertLocked(std::string const &table, MadContentValues::Impl &values);
+
+    sqlite3_stmt *insertStatement(std::string const &table, MadContentValues::Impl const &values);
+
+    void finalizeInsertStatements();
+
+    void writeGroup(std::vector<MadGroupCommit::Unit *> &group);
+
     MadQuery query(std::string const &sql, std::vector<std::string> const &args);
 
     int exec(std::string const &sql);
 
-    void beginTransaction();
+    void beginTransaction(TransactionMode mode);
 
     void rollbackTransaction();
 
-    void commitTransaction();
+    bool commitTransaction();
+
+    void setGroupCommit(bool enabled, GroupCommitOptions const &options);
+
+    void setAutoBatch(bool enabled, AutoBatchOptions const &options);
+
+    bool flush();
+
+    bool flushLocked();
+
+    void runBatchTimer();
+
+    bool preload(std::string const &path, int flags, OpenOptions const &options);
+
+    void runWriteBackTimer(long long intervalMillis);
+
+    bool backupTo(std::string const &path, int pagesPerStep, int sleepBetweenStepsMillis,
+                  BackupProgress const &progress);
+
+    bool backupTo(Impl &destination, int pagesPerStep, int sleepBetweenStepsMillis, BackupProgress const &progress);
+
+    std::future<bool> backupToAsync(std::string const &path, int pagesPerStep, int sleepBetweenStepsMillis,
+                                    BackupProgress progress);
+
+    bool backup(sqlite3 *destination, std::mutex *destinationMutex, int pagesPerStep, int sleepBetweenStepsMillis,
+                BackupProgress const &progress);
+
+    void setBusyHandler(BusyHandler handler);
+
+    Metrics getMetrics();
 
 //endregion
 
@@ -0,0 +1,106 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadGroupCommit.hpp"
+#include <chrono>
+
+using namespace madsqlite;
+using namespace std;
+
+//region Constructor
+
+MadGroupCommit::MadGroupCommit(Writer writer) : writer(move(writer)) {}
+
+MadGroupCommit::~MadGroupCommit() {}
+
+//endregion
+
+//region Methods
+
+void MadGroupCommit::setOptions(MadDatabase::GroupCommitOptions const &groupOptions) {
+    lock_guard<mutex> guard(groupMutex);
+    options = groupOptions;
+}
+
+bool MadGroupCommit::begin() {
+    lock_guard<mutex> guard(groupMutex);
+    auto &unit = openUnits[this_thread::get_id()];
+    if (unit) {
+        return false;
+    }
+    unit = make_unique<Unit>();
+    return true;
+}
+
+bool MadGroupCommit::isOpen() {
+    lock_guard<mutex> guard(groupMutex);
+    return openUnits.find(this_thread::get_id()) != openUnits.end();
+}
+
+void MadGroupCommit::add(Operation &&operation, size_t bytes) {
+    lock_guard<mutex> guard(groupMutex);
+    auto itr = openUnits.find(this_thread::get_id());
+    if (itr != openUnits.end()) {
+        itr->second->operations.emplace_back(move(operation));
+        itr->second->rows += 1;
+        itr->second->bytes += bytes;
+    }
+}
+
+void MadGroupCommit::rollback() {
+    lock_guard<mutex> guard(groupMutex);
+    openUnits.erase(this_thread::get_id());
+}
+
+bool MadGroupCommit::commit() {
+    unique_lock<mutex> lock(groupMutex);
+    auto itr = openUnits.find(this_thread::get_id());
+    if (itr == openUnits.end()) {
+        return false;
+    }
+    auto unit = move(itr->second);
+    openUnits.erase(itr);
+    if (unit->operations.empty()) {
+        return true;
+    }
+
+    queue.push_back(unit.get());
+    queuedRows += unit->rows;
+    queuedBytes += unit->bytes;
+    groupCondition.notify_all();
+
+    while (!unit->done) {
+        if (leaderActive) {
+            groupCondition.wait(lock);
+            continue;
+        }
+
+        // This thread leads the next group: wait for others to join it then write everything queued.
+        leaderActive = true;
+        auto deadline = chrono::steady_clock::now() + chrono::microseconds(options.windowMicros);
+        while (!isBudgetReached() && groupCondition.wait_until(lock, deadline) != cv_status::timeout) {}
+
+        vector<Unit *> group;
+        group.swap(queue);
+        queuedRows = 0;
+        queuedBytes = 0;
+
+        lock.unlock();
+        writer(group);
+        lock.lock();
+
+        for (auto member : group) {
+            member->done = true;
+        }
+        leaderActive = false;
+        groupCondition.notify_all();
+    }
+    return unit->committed;
+}
+
+bool MadGroupCommit::isBudgetReached() const {
+    return queuedRows >= options.maxRows || queuedBytes >= options.maxBytes;
+}
+
+//endregion
@@ -0,0 +1,108 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_MADGROUPCOMMIT_HPP
+#define PROJECT_MADGROUPCOMMIT_HPP
+
+#include "MadDatabase.hpp"
+#include "MadContentValues.hpp"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace madsqlite {
+
+/**
+ * Collects the transactions of many threads and hands them to a single writer so that they share one sqlite
+ * transaction and one sync.
+ */
+class MadGroupCommit {
+
+public:
+
+    /**
+     * A deferred insert (table and values) or statement (sql).
+     */
+    struct Operation {
+        std::string table;
+        MadContentValues values;
+        std::string sql;
+    };
+
+    /**
+     * The operations of one thread's transaction.
+     */
+    struct Unit {
+        std::vector<Operation> operations;
+        size_t rows = 0;
+        size_t bytes = 0;
+        bool done = false;
+        bool committed = false;
+    };
+
+    /**
+     * Writes a group of units and marks each one that was committed.
+     */
+    typedef std::function<void(std::vector<Unit *> &group)> Writer;
+
+//region Constructor
+
+public:
+
+    MadGroupCommit(Writer writer);
+
+    MadGroupCommit(MadGroupCommit &other) = delete;
+
+    virtual ~MadGroupCommit();
+
+//endregion
+
+//region Members
+
+private:
+
+    Writer writer;
+    MadDatabase::GroupCommitOptions options;
+    std::mutex groupMutex;
+    std::condition_variable groupCondition;
+    std::unordered_map<std::thread::id, std::unique_ptr<Unit>> openUnits;
+    std::vector<Unit *> queue;
+    size_t queuedRows = 0;
+    size_t queuedBytes = 0;
+    bool leaderActive = false;
+
+//endregion
+
+//region Methods
+
+public:
+
+    void setOptions(MadDatabase::GroupCommitOptions const &groupOptions);
+
+    bool begin();
+
+    bool isOpen();
+
+    void add(Operation &&operation, size_t bytes);
+
+    void rollback();
+
+    bool commit();
+
+private:
+
+    bool isBudgetReached() const;
+
+//endregion
+
+};
+
+}
+
+#endif //PROJECT_MADGROUPCOMMIT_HPP
@@ -0,0 +1,184 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadLz4.hpp"
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace madsqlite;
+using namespace std;
+
+static const int minMatch = 4;
+// the last 5 bytes are always literals and the last match starts at least 12 bytes before the end
+static const int lastLiterals = 5;
+static const int matchFindLimit = 12;
+static const int hashLog = 12;
+static const int maxOffset = 65535;
+
+static inline uint32_t read32(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hashOf(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - hashLog);
+}
+
+/**
+ * Writes the 255 continuation bytes of a length which did not fit its 4 bits of the token.
+ */
+static inline bool writeLength(int length, char *&out, const char *end) {
+    for (; length >= 255; length -= 255) {
+        if (out >= end) {
+            return false;
+        }
+        *out++ = (char) 255;
+    }
+    if (out >= end) {
+        return false;
+    }
+    *out++ = (char) length;
+    return true;
+}
+
+static bool writeSequence(const char *literals, int literalLength, int offset, int matchLength,
+                          char *&out, const char *end) {
+    if (out >= end) {
+        return false;
+    }
+    char *token = out++;
+    int matchCode = matchLength ? matchLength - minMatch : 0;
+    *token = (char) (((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (literalLength >= 15 && !writeLength(literalLength - 15, out, end)) {
+        return false;
+    }
+    if (end - out < literalLength) {
+        return false;
+    }
+    memcpy(out, literals, (size_t) literalLength);
+    out += literalLength;
+    if (matchLength == 0) {
+        return true;
+    }
+    if (end - out < 2) {
+        return false;
+    }
+    *out++ = (char) (offset & 0xFF);
+    *out++ = (char) (offset >> 8);
+    return matchCode < 15 || writeLength(matchCode - 15, out, end);
+}
+
+int MadLz4::compressBound(int size) {
+    return size + size / 255 + 16;
+}
+
+int MadLz4::compress(const char *source, int sourceSize, char *destination, int destinationCapacity) {
+    char *out = destination;
+    const char *end = destination + destinationCapacity;
+    int anchor = 0;
+    if (sourceSize > matchFindLimit) {
+        // positions plus one, zero is empty
+        vector<int> table(1 << hashLog, 0);
+        int limit = sourceSize - matchFindLimit;
+        int position = 0;
+        while (position < limit) {
+            uint32_t sequence = read32(source + position);
+            uint32_t hash = hashOf(sequence);
+            int reference = table[hash] - 1;
+            table[hash] = position + 1;
+            if (reference < 0 || position - reference > maxOffset || read32(source + reference) != sequence) {
+                ++position;
+                continue;
+            }
+            int matchLength = minMatch;
+            while (position + matchLength < sourceSize - lastLiterals &&
+                   source[reference + matchLength] == source[position + matchLength]) {
+                ++matchLength;
+            }
+            if (!writeSequence(source + anchor, position - anchor, position - reference, matchLength, out, end)) {
+                return 0;
+            }
+            position += matchLength;
+            anchor = position;
+        }
+    }
+    if (!writeSequence(source + anchor, sourceSize - anchor, 0, 0, out, end)) {
+        return 0;
+    }
+    return (int) (out - destination);
+}
+
+int MadLz4::decompress(const char *source, int sourceSize, char *destination, int destinationCapacity) {
+    const char *in = source;
+    const char *inEnd = source + sourceSize;
+    char *out = destination;
+    char *outEnd = destination + destinationCapacity;
+    while (in < inEnd) {
+        unsigned token = (unsigned char) *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15) {
+            unsigned char extra;
+            do {
+                if (in >= inEnd) {
+                    return -1;
+                }
+                extra = (unsigned char) *in++;
+                literalLength += extra;
+            } while (extra == 255);
+        }
+        if ((size_t) (inEnd - in) < literalLength || (size_t) (outEnd - out) < literalLength) {
+            return -1;
+        }
+        if (literalLength <= 16 && inEnd - in >= 16 && outEnd - out >= 16) {
+            // a fixed size copy of short literals, the bytes past them are overwritten or ignored
+            memcpy(out, in, 16);
+        } else {
+            memcpy(out, in, literalLength);
+        }
+        in += literalLength;
+        out += literalLength;
+        if (in == inEnd) {
+            // the last sequence has no match
+            break;
+        }
+        if (inEnd - in < 2) {
+            return -1;
+        }
+        size_t offset = (unsigned char) in[0] | ((unsigned char) in[1] << 8);
+        in += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15) {
+            unsigned char extra;
+            do {
+                if (in >= inEnd) {
+                    return -1;
+                }
+                extra = (unsigned char) *in++;
+                matchLength += extra;
+            } while (extra == 255);
+        }
+        matchLength += minMatch;
+        if (offset == 0 || offset > (size_t) (out - destination) || (size_t) (outEnd - out) < matchLength) {
+            return -1;
+        }
+        // a match overlapping its own output repeats with a period of the offset, copy whole periods at a time
+        size_t copied = 0;
+        if (offset >= 16 && matchLength <= 32 && outEnd - out >= 32) {
+            memcpy(out, out - offset, 16);
+            memcpy(out + 16, out + 16 - offset, 16);
+            copied = matchLength;
+        }
+        while (copied < matchLength) {
+            size_t period = offset * ((copied + offset) / offset);
+            size_t length = min(period, matchLength - copied);
+            memcpy(out + copied, out + copied - period, length);
+            copied += length;
+        }
+        out += matchLength;
+    }
+    return (int) (out - destination);
+}
@@ -0,0 +1,37 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_MADLZ4_HPP
+#define PROJECT_MADLZ4_HPP
+
+namespace madsqlite {
+
+/**
+ * A compressor and decompressor of the LZ4 block format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ * Favors speed over ratio, which suits database pages read far more often than they are written.
+ */
+class MadLz4 {
+
+public:
+
+    /**
+     * The largest compressed size of an input of the given size.
+     */
+    static int compressBound(int size);
+
+    /**
+     * @return the compressed size, or 0 if the compressed input does not fit the destination.
+     */
+    static int compress(const char *source, int sourceSize, char *destination, int destinationCapacity);
+
+    /**
+     * @return the decompressed size, or -1 if the input is malformed or does not fit the destination.
+     */
+    static int decompress(const char *source, int sourceSize, char *destination, int destinationCapacity);
+
+};
+
+}
+
+#endif //PROJECT_MADLZ4_HPP
@@ -0,0 +1,417 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadPageCache.hpp"
+#include "sqlite3.h"
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+using namespace madsqlite;
+using namespace std;
+
+namespace {
+
+struct ArenaCache;
+
+/**
+ * A page handed to sqlite, either an arena slot or a heap allocation.
+ */
+struct ArenaPage {
+    sqlite3_pcache_page base;
+    ArenaCache *cache = nullptr;
+    unsigned key = 0;
+    bool isPinned = false;
+    bool isHeap = false;
+    char *memory = nullptr;
+    // the size of the memory of a heap page
+    size_t size = 0;
+    list<ArenaPage *>::iterator lruPosition;
+};
+
+/**
+ * The pages of one sqlite page cache.
+ */
+struct ArenaCache {
+    int pageSize;
+    int extraSize;
+    bool isPurgeable;
+    // the cache size sqlite asks for, a cap on the heap pages of the cache
+    unsigned maxPages = 0;
+    unsigned heapPages = 0;
+    unordered_map<unsigned, ArenaPage *> pages;
+};
+
+}
+
+static mutex cacheMutex;
+static bool isInstalled = false;
+static char *arena = nullptr;
+static size_t arenaSize = 0;
+static size_t slotSize = 0;
+static vector<ArenaPage> slots;
+static vector<ArenaPage *> freeSlots;
+static size_t heapBytes = 0;
+// unpinned pages of purgeable caches, most recently used first
+static list<ArenaPage *> lru;
+static MadDatabase::PageCacheStats stats;
+
+static char *mapArena(size_t size, bool hugePages) {
+#ifdef _WIN32
+    return static_cast<char *>(malloc(size));
+#else
+#ifdef MAP_HUGETLB
+    if (hugePages) {
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            stats.isHugePages = true;
+            return static_cast<char *>(memory);
+        }
+    }
+#endif
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? nullptr : static_cast<char *>(memory);
+#endif
+}
+
+static void unmapArena() {
+#ifdef _WIN32
+    free(arena);
+#else
+    munmap(arena, arenaSize);
+#endif
+    arena = nullptr;
+}
+
+/**
+ * Returns a page to the arena or the heap, the page must be removed from its cache by the caller.
+ */
+static void releasePage(ArenaPage *page) {
+    if (!page->isPinned && page->cache->isPurgeable) {
+        lru.erase(page->lruPosition);
+    }
+    if (page->isHeap) {
+        --page->cache->heapPages;
+        heapBytes -= page->size;
+        free(page->memory);
+        delete page;
+        --stats.heapPages;
+    } else {
+        page->cache = nullptr;
+        freeSlots.push_back(page);
+        --stats.usedPages;
+    }
+}
+
+/**
+ * Whether pages of size more bytes fit in the budget of the arena, which the arena slots in use and the heap pages
+ * share.
+ */
+static bool fitsBudget(size_t size) {
+    return (size_t) stats.usedPages * slotSize + heapBytes + size <= arenaSize;
+}
+
+/**
+ * @return the least recently used unpinned page that matches, nullptr if there is none.
+ */
+template<typename Match>
+static ArenaPage *leastRecent(Match match) {
+    for (auto itr = lru.rbegin(); itr != lru.rend(); ++itr) {
+        if (match(*itr)) {
+            return *itr;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Evicts the least recently used unpinned page that matches.
+ *
+ * @return true if a page was evicted.
+ */
+template<typename Match>
+static bool evictLeastRecent(Match match) {
+    auto victim = leastRecent(match);
+    if (!victim) {
+        return false;
+    }
+    victim->cache->pages.erase(victim->key);
+    releasePage(victim);
+    ++stats.evictions;
+    return true;
+}
+
+static function<bool(ArenaPage *)> isHeapPageOf(ArenaCache *cache) {
+    return [cache](ArenaPage *candidate) { return candidate->isHeap && candidate->cache == cache; };
+}
+
+/**
+ * Takes an unpinned heap page from its cache to reuse its memory.
+ */
+static ArenaPage *reuseHeapPage(ArenaPage *victim) {
+    lru.erase(victim->lruPosition);
+    victim->cache->pages.erase(victim->key);
+    --victim->cache->heapPages;
+    ++stats.evictions;
+    return victim;
+}
+
+/**
+ * Takes a page for the cache from the free slots, by evicting the least recently used unpinned arena page, or from
+ * the heap when the page does not fit a slot or, when it must not fail, the arena is exhausted. Unpinned pages are
+ * clean, sqlite keeps dirty pages pinned, so evicting one never costs a write and is done for either create flag.
+ *
+ * Heap pages are held to the cache size of their cache and count against the budget of the arena. Past either, the
+ * least recently used heap page of the same size is reused, or other pages are evicted to make room; only a page
+ * that must not fail is allocated over them.
+ */
+static ArenaPage *allocatePage(ArenaCache *cache, bool mustAllocate) {
+    size_t size = (size_t) (cache->pageSize + cache->extraSize);
+    auto isArenaPage = [](ArenaPage *page) { return !page->isHeap; };
+    auto isHeapPage = [](ArenaPage *page) { return page->isHeap; };
+    ArenaPage *page = nullptr;
+    if (size <= slotSize) {
+        if (freeSlots.empty()) {
+            evictLeastRecent(isArenaPage);
+        }
+        while (!freeSlots.empty() && !fitsBudget(slotSize) && evictLeastRecent(isHeapPage)) {}
+        if (!freeSlots.empty() && (mustAllocate || fitsBudget(slotSize))) {
+            page = freeSlots.back();
+            freeSlots.pop_back();
+            ++stats.usedPages;
+        }
+    }
+    if (!page && (size > slotSize || mustAllocate)) {
+        ArenaPage *victim = nullptr;
+        if (cache->heapPages >= cache->maxPages) {
+            victim = leastRecent(isHeapPageOf(cache));
+        } else if (!fitsBudget(size)) {
+            victim = leastRecent([size](ArenaPage *candidate) {
+                return candidate->isHeap && candidate->size == size;
+            });
+            while (!victim && !fitsBudget(size) && evictLeastRecent([](ArenaPage *) { return true; })) {}
+        }
+        if (victim) {
+            page = reuseHeapPage(victim);
+        } else if (mustAllocate || (cache->heapPages < cache->maxPages && fitsBudget(size))) {
+            char *memory = static_cast<char *>(malloc(size));
+            if (!memory) {
+                return nullptr;
+            }
+            page = new ArenaPage();
+            page->isHeap = true;
+            page->memory = memory;
+            page->size = size;
+            heapBytes += size;
+            ++stats.heapPages;
+        }
+    }
+    if (page) {
+        page->cache = cache;
+        if (page->isHeap) {
+            ++cache->heapPages;
+        }
+        page->base.pBuf = page->memory;
+        page->base.pExtra = page->memory + cache->pageSize;
+        // sqlite expects the start of the extra bytes of a new page to be zero
+        memset(page->base.pExtra, 0, (size_t) cache->extraSize);
+    }
+    return page;
+}
+
+//region sqlite3_pcache_methods2
+
+static int pcacheInit(void *) {
+    return SQLITE_OK;
+}
+
+static void pcacheShutdown(void *) {}
+
+static sqlite3_pcache *pcacheCreate(int pageSize, int extraSize, int isPurgeable) {
+    auto cache = new ArenaCache();
+    cache->pageSize = pageSize;
+    cache->extraSize = extraSize;
+    cache->isPurgeable = isPurgeable != 0;
+    return reinterpret_cast<sqlite3_pcache *>(cache);
+}
+
+static void pcacheCachesize(sqlite3_pcache *pcache, int maxPages) {
+    // the arena is the budget of the arena pages of every cache, the cache size caps the heap pages of one
+    auto cache = reinterpret_cast<ArenaCache *>(pcache);
+    lock_guard<mutex> guard(cacheMutex);
+    cache->maxPages = (unsigned) max(maxPages, 0);
+    while (cache->heapPages > cache->maxPages && evictLeastRecent(isHeapPageOf(cache))) {}
+}
+
+static int pcachePagecount(sqlite3_pcache *pcache) {
+    lock_guard<mutex> guard(cacheMutex);
+    return (int) reinterpret_cast<ArenaCache *>(pcache)->pages.size();
+}
+
+static sqlite3_pcache_page *pcacheFetch(sqlite3_pcache *pcache, unsigned key, int createFlag) {
+    auto cache = reinterpret_cast<ArenaCache *>(pcache);
+    lock_guard<mutex> guard(cacheMutex);
+    auto itr = cache->pages.find(key);
+    if (itr != cache->pages.end()) {
+        auto page = itr->second;
+        if (!page->isPinned) {
+            if (cache->isPurgeable) {
+                lru.erase(page->lruPosition);
+            }
+            page->isPinned = true;
+        }
+        ++stats.hits;
+        return &page->base;
+    }
+    ++stats.misses;
+    if (createFlag == 0) {
+        return nullptr;
+    }
+    auto page = allocatePage(cache, createFlag == 2);
+    if (!page) {
+        return nullptr;
+    }
+    page->key = key;
+    page->isPinned = true;
+    cache->pages[key] = page;
+    return &page->base;
+}
+
+static void pcacheUnpin(sqlite3_pcache *pcache, sqlite3_pcache_page *pcachePage, int discard) {
+    auto cache = reinterpret_cast<ArenaCache *>(pcache);
+    auto page = reinterpret_cast<ArenaPage *>(pcachePage);
+    lock_guard<mutex> guard(cacheMutex);
+    page->isPinned = false;
+    if (cache->isPurgeable) {
+        lru.push_front(page);
+        page->lruPosition = lru.begin();
+    }
+    if (discard) {
+        cache->pages.erase(page->key);
+        releasePage(page);
+    }
+}
+
+static void pcacheRekey(sqlite3_pcache *pcache, sqlite3_pcache_page *pcachePage, unsigned oldKey, unsigned newKey) {
+    auto cache = reinterpret_cast<ArenaCache *>(pcache);
+    auto page = reinterpret_cast<ArenaPage *>(pcachePage);
+    lock_guard<mutex> guard(cacheMutex);
+    auto itr = cache->pages.find(newKey);
+    if (itr != cache->pages.end() && itr->second != page) {
+        auto replaced = itr->second;
+        cache->pages.erase(itr);
+        releasePage(replaced);
+    }
+    cache->pages.erase(oldKey);
+    page->key = newKey;
+    cache->pages[newKey] = page;
+}
+
+static void pcacheTruncate(sqlite3_pcache *pcache, unsigned limit) {
+    auto cache = reinterpret_cast<ArenaCache *>(pcache);
+    lock_guard<mutex> guard(cacheMutex);
+    for (auto itr = cache->pages.begin(); itr != cache->pages.end();) {
+        if (itr->first >= limit) {
+            releasePage(itr->second);
+            itr = cache->pages.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+}
+
+static void pcacheDestroy(sqlite3_pcache *pcache) {
+    auto cache = reinterpret_cast<ArenaCache *>(pcache);
+    {
+        lock_guard<mutex> guard(cacheMutex);
+        for (auto &&entry : cache->pages) {
+            releasePage(entry.second);
+        }
+    }
+    delete cache;
+}
+
+static void pcacheShrink(sqlite3_pcache *pcache) {
+    auto cache = reinterpret_cast<ArenaCache *>(pcache);
+    lock_guard<mutex> guard(cacheMutex);
+    for (auto itr = cache->pages.begin(); itr != cache->pages.end();) {
+        if (!itr->second->isPinned) {
+            releasePage(itr->second);
+            itr = cache->pages.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+}
+
+//endregion
+
+//region MadPageCache
+
+bool MadPageCache::install(MadDatabase::PageCacheOptions const &options) {
+    lock_guard<mutex> guard(cacheMutex);
+    if (isInstalled) {
+        return false;
+    }
+    // room for the extra bytes sqlite keeps with each page
+    slotSize = (size_t) options.pageSize + 512;
+    size_t slotCount = options.arenaBytes / slotSize;
+    arenaSize = slotCount * slotSize;
+    stats = MadDatabase::PageCacheStats();
+    heapBytes = 0;
+    arena = slotCount ? mapArena(arenaSize, options.hugePages) : nullptr;
+    if (!arena) {
+        return false;
+    }
+
+    static const sqlite3_pcache_methods2 methods = {
+            1,
+            nullptr,
+            pcacheInit,
+            pcacheShutdown,
+            pcacheCreate,
+            pcacheCachesize,
+            pcachePagecount,
+            pcacheFetch,
+            pcacheUnpin,
+            pcacheRekey,
+            pcacheTruncate,
+            pcacheDestroy,
+            pcacheShrink,
+    };
+    sqlite3_shutdown();
+    if (sqlite3_config(SQLITE_CONFIG_PCACHE2, &methods) != SQLITE_OK) {
+        unmapArena();
+        sqlite3_initialize();
+        return false;
+    }
+    sqlite3_initialize();
+
+    slots = vector<ArenaPage>(slotCount);
+    freeSlots.clear();
+    for (size_t i = slotCount; i > 0; --i) {
+        auto &slot = slots[i - 1];
+        slot.memory = arena + (i - 1) * slotSize;
+        freeSlots.push_back(&slot);
+    }
+    stats.capacityPages = (long long) slotCount;
+    isInstalled = true;
+    return true;
+}
+
+MadDatabase::PageCacheStats MadPageCache::getStats() {
+    lock_guard<mutex> guard(cacheMutex);
+    return stats;
+}
+
+//endregion
@@ -0,0 +1,29 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_MADPAGECACHE_HPP
+#define PROJECT_MADPAGECACHE_HPP
+
+#include "MadDatabase.hpp"
+
+namespace madsqlite {
+
+/**
+ * A sqlite3_pcache_methods2 implementation taking the pages of every database from one preallocated arena with a
+ * single least recently used list of unpinned pages, so that the page caches of all open databases share one
+ * memory budget.
+ */
+class MadPageCache {
+
+public:
+
+    static bool install(MadDatabase::PageCacheOptions const &options);
+
+    static MadDatabase::PageCacheStats getStats();
+
+};
+
+}
+
+#endif //PROJECT_MADPAGECACHE_HPP
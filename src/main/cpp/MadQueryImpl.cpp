@@ -29,8 +29,12 @@ MadQuery::~MadQuery() {}
 
 MadQuery::Impl::Impl(sqlite3_stmt *statement) : statement(statement) {}
 
+MadQuery::Impl::Impl(sqlite3_stmt *statement, mutex *connectionMutex) :
+        statement(statement), connectionMutex(connectionMutex) {}
+
 MadQuery::Impl::Impl(Impl &&other) {
     statement = other.statement;
+    connectionMutex = other.connectionMutex;
     position = other.position;
     other.statement = nullptr;
     other.position = 0;
@@ -38,6 +42,7 @@ MadQuery::Impl::Impl(Impl &&other) {
 
 MadQuery::Impl::~Impl() {
     if (NULL != statement) {
+        auto lock = lockConnection();
         sqlite3_finalize(statement);
     }
 }
@@ -79,6 +84,7 @@ double MadQuery::getReal(int columnIndex) {
 //region MadQuery::Impl
 
 bool MadQuery::Impl::moveToFirst() {
+    auto lock = lockConnection();
     if (sqlite3_reset(statement) == SQLITE_OK) {
         stepResult = sqlite3_step(statement);
         position = 0;
@@ -91,6 +97,7 @@ bool MadQuery::Impl::moveToFirst() {
 
 bool MadQuery::Impl::moveToNext() {
     if (!isAfterLast()) {
+        auto lock = lockConnection();
         stepResult = sqlite3_step(statement);
         if (stepResult == SQLITE_ROW || SQLITE_DONE) {
             ++position;
@@ -105,6 +112,7 @@ bool MadQuery::Impl::isAfterLast() {
 }
 
 const string MadQuery::Impl::getString(int columnIndex) const {
+    auto lock = lockConnection();
     const unsigned char* text = sqlite3_column_text(statement, columnIndex);
     if (text) {
         return string(reinterpret_cast<const char*>(text));
@@ -113,6 +121,7 @@ const string MadQuery::Impl::getString(int columnIndex) const {
 }
 
 const vector<unsigned char> MadQuery::Impl::getBlob(int columnIndex) const {
+    auto lock = lockConnection();
     const void *blob = sqlite3_column_blob(statement, columnIndex);
     int sz = sqlite3_column_bytes(statement, columnIndex);
     const unsigned char *charBuf = reinterpret_cast<const unsigned char*>(blob);
@@ -121,11 +130,20 @@ const vector<unsigned char> MadQuery::Impl::getBlob(int columnIndex) const {
 }
 
 long long int MadQuery::Impl::getInt(int columnIndex) {
+    auto lock = lockConnection();
     return (long long int) sqlite3_column_int64(statement, columnIndex);
 }
 
 double MadQuery::Impl::getReal(int columnIndex) {
+    auto lock = lockConnection();
     return sqlite3_column_double(statement, columnIndex);
 }
 
+unique_lock<mutex> MadQuery::Impl::lockConnection() const {
+    if (connectionMutex) {
+        return unique_lock<mutex>(*connectionMutex);
+    }
+    return unique_lock<mutex>();
+}
+
 //endregion
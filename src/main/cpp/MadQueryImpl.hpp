@@ -5,6 +5,7 @@
 #ifndef PROJECT_MADQUERYIMPL_HPP
 #define PROJECT_MADQUERYIMPL_HPP
 
+#include <mutex>
 #include "sqlite3.h"
 #include "MadQuery.hpp"
 
@@ -17,6 +18,7 @@ class MadQuery::Impl {
 private:
 
     sqlite3_stmt *statement;
+    std::mutex *connectionMutex = nullptr;
     int position = -1;
     int stepResult = -1;
 
@@ -28,6 +30,11 @@ public:
 
     Impl(sqlite3_stmt *statement);
 
+    /**
+     * @param connectionMutex held while the statement is used when sqlite does not serialize its connection, or null.
+     */
+    Impl(sqlite3_stmt *statement, std::mutex *connectionMutex);
+
     Impl(Impl &&other);
 
     Impl(Impl &other) = delete; // disallow copy
@@ -52,6 +59,10 @@ public:
 
     double getReal(int columnIndex);
 
+private:
+
+    std::unique_lock<std::mutex> lockConnection() const;
+
 //endregion
 
 };
@@ -0,0 +1,732 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadUringVfs.hpp"
+#include "sqlite3.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MADSQLITE_HAS_IO_URING 1
+#endif
+#endif
+
+#ifdef MADSQLITE_HAS_IO_URING
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#endif
+
+using namespace madsqlite;
+using namespace std;
+
+const char *const MadUringVfs::name = "madsqlite-uring";
+const char *const MadUringVfs::directName = "madsqlite-uring-direct";
+
+#ifndef MADSQLITE_HAS_IO_URING
+
+bool MadUringVfs::ensureInstalled() {
+    return false;
+}
+
+#else
+
+namespace {
+
+const unsigned ringEntries = 64;
+// writes queued before they are submitted without waiting for a sync
+const size_t submitBatch = 32;
+const size_t directAlignment = 4096;
+
+/**
+ * A write owned by the ring until its completion is reaped.
+ */
+struct PendingWrite {
+    sqlite3_int64 offset;
+    iovec io;
+    bool isSubmitted = false;
+};
+
+/**
+ * The mapped submission and completion queues of an io_uring.
+ */
+struct Ring {
+    int fd = -1;
+    void *ringMap = nullptr;
+    size_t ringMapSize = 0;
+    void *completionMap = nullptr;
+    size_t completionMapSize = 0;
+    io_uring_sqe *entries = nullptr;
+    size_t entriesSize = 0;
+    unsigned *submitHead = nullptr;
+    unsigned *submitTail = nullptr;
+    unsigned submitMask = 0;
+    unsigned *submitArray = nullptr;
+    unsigned *completeHead = nullptr;
+    unsigned *completeTail = nullptr;
+    unsigned completeMask = 0;
+    io_uring_cqe *completions = nullptr;
+
+    bool open(unsigned count) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = (int) syscall(__NR_io_uring_setup, count, &params);
+        if (fd < 0) {
+            return false;
+        }
+        ringMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        completionMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool isSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (isSingleMap) {
+            ringMapSize = completionMapSize = max(ringMapSize, completionMapSize);
+        }
+        ringMap = mmap(nullptr, ringMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ringMap == MAP_FAILED) {
+            ringMap = nullptr;
+            close();
+            return false;
+        }
+        completionMap = isSingleMap ? ringMap : mmap(nullptr, completionMapSize, PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *entriesMap = mmap(nullptr, entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_SQES);
+        if (completionMap == MAP_FAILED || entriesMap == MAP_FAILED) {
+            completionMap = completionMap == MAP_FAILED ? nullptr : completionMap;
+            entries = entriesMap == MAP_FAILED ? nullptr : static_cast<io_uring_sqe *>(entriesMap);
+            close();
+            return false;
+        }
+        auto ring = static_cast<char *>(ringMap);
+        auto completion = static_cast<char *>(completionMap);
+        entries = static_cast<io_uring_sqe *>(entriesMap);
+        submitHead = reinterpret_cast<unsigned *>(ring + params.sq_off.head);
+        submitTail = reinterpret_cast<unsigned *>(ring + params.sq_off.tail);
+        submitMask = *reinterpret_cast<unsigned *>(ring + params.sq_off.ring_mask);
+        submitArray = reinterpret_cast<unsigned *>(ring + params.sq_off.array);
+        completeHead = reinterpret_cast<unsigned *>(completion + params.cq_off.head);
+        completeTail = reinterpret_cast<unsigned *>(completion + params.cq_off.tail);
+        completeMask = *reinterpret_cast<unsigned *>(completion + params.cq_off.ring_mask);
+        completions = reinterpret_cast<io_uring_cqe *>(completion + params.cq_off.cqes);
+        return true;
+    }
+
+    void close() {
+        if (entries) {
+            munmap(entries, entriesSize);
+        }
+        if (completionMap && completionMap != ringMap) {
+            munmap(completionMap, completionMapSize);
+        }
+        if (ringMap) {
+            munmap(ringMap, ringMapSize);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+        entries = nullptr;
+        completionMap = ringMap = nullptr;
+    }
+
+    /**
+     * @return the next free submission entry, or nullptr when the queue is full.
+     */
+    io_uring_sqe *nextEntry() {
+        unsigned tail = *submitTail;
+        if (tail - __atomic_load_n(submitHead, __ATOMIC_ACQUIRE) > submitMask) {
+            return nullptr;
+        }
+        auto entry = &entries[tail & submitMask];
+        memset(entry, 0, sizeof(*entry));
+        submitArray[tail & submitMask] = tail & submitMask;
+        return entry;
+    }
+
+    void push() {
+        __atomic_store_n(submitTail, *submitTail + 1, __ATOMIC_RELEASE);
+    }
+
+    int enter(unsigned submitCount, unsigned waitCount) {
+        int rc;
+        do {
+            rc = (int) syscall(__NR_io_uring_enter, fd, submitCount, waitCount,
+                               waitCount ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        } while (rc < 0 && errno == EINTR);
+        return rc;
+    }
+};
+
+/**
+ * The queued and submitted writes of one open file.
+ */
+struct UringState {
+    mutex stateMutex;
+    string path;
+    Ring ring;
+    int fd = -1;
+    int directFd = -1;
+    // the descriptors belong to the inode table, see acquireDescriptors
+    bool isInodeShared = false;
+    pair<dev_t, ino_t> inode;
+    list<PendingWrite *> pending;
+    size_t queued = 0;
+    size_t inFlight = 0;
+    unsigned unsubmitted = 0;
+    sqlite3_int64 pendingEnd = 0;
+    int error = SQLITE_OK;
+    bool isSynced = false;
+};
+
+/**
+ * The descriptors of one main database file the rings write with.
+ */
+struct InodeDescriptors {
+    int fd = -1;
+    int directFd = -1;
+    int handles = 0;
+    // descriptors opened while another process replaced the file
+    vector<int> extra;
+};
+
+/**
+ * The sqlite3_file of the vfs, followed in memory by the sqlite3_file of the wrapped vfs.
+ */
+struct UringHandle {
+    sqlite3_file base;
+    sqlite3_file *real;
+    UringState *state;
+};
+
+}
+
+static mutex installMutex;
+static bool isInstalled = false;
+static bool isAvailable = false;
+static sqlite3_vfs uringVfs;
+static sqlite3_vfs directVfs;
+static sqlite3_vfs *rootVfs = nullptr;
+// the open states by path, to make WAL frames visible before the WAL index publishes them
+static mutex statesMutex;
+static unordered_map<string, unordered_set<UringState *>> openStates;
+// closing any descriptor of a file drops the POSIX locks every connection of the process holds on it, so like the
+// unixInodeInfo of sqlite the descriptors of main database files are shared by inode and kept while the file exists
+static mutex inodesMutex;
+static map<pair<dev_t, ino_t>, InodeDescriptors> inodeDescriptors;
+
+//region Descriptors
+
+static void closeDescriptors(InodeDescriptors &descriptors) {
+    for (int fd : descriptors.extra) {
+        close(fd);
+    }
+    if (descriptors.directFd >= 0) {
+        close(descriptors.directFd);
+    }
+    if (descriptors.fd >= 0) {
+        close(descriptors.fd);
+    }
+}
+
+/**
+ * Closes the descriptors of deleted files no handle uses, no other process can open and lock those.
+ */
+static void pruneDescriptorsLocked() {
+    for (auto itr = inodeDescriptors.begin(); itr != inodeDescriptors.end();) {
+        auto &descriptors = itr->second;
+        int fd = descriptors.fd >= 0 ? descriptors.fd : descriptors.extra.empty() ? -1 : descriptors.extra.front();
+        struct stat info;
+        if (descriptors.handles == 0 && (fd < 0 || (fstat(fd, &info) == 0 && info.st_nlink == 0))) {
+            closeDescriptors(descriptors);
+            itr = inodeDescriptors.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+}
+
+/**
+ * Sets the write descriptors of a main database file, shared with the other handles of the file.
+ */
+static bool acquireDescriptors(UringState &state, bool isDirect) {
+    lock_guard<mutex> guard(inodesMutex);
+    pruneDescriptorsLocked();
+    struct stat info;
+    if (stat(state.path.c_str(), &info) != 0) {
+        return false;
+    }
+    auto key = make_pair(info.st_dev, info.st_ino);
+    auto &descriptors = inodeDescriptors[key];
+    if (descriptors.fd < 0) {
+        int fd = open(state.path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat opened;
+        if (fstat(fd, &opened) == 0 && (opened.st_dev != info.st_dev || opened.st_ino != info.st_ino)) {
+            // the file was replaced since the stat, the descriptor stays with the inode it refers to
+            inodeDescriptors[make_pair(opened.st_dev, opened.st_ino)].extra.push_back(fd);
+            return false;
+        }
+        descriptors.fd = fd;
+    }
+    if (isDirect && descriptors.directFd < 0) {
+        descriptors.directFd = open(state.path.c_str(), O_WRONLY | O_CLOEXEC | O_DIRECT);
+    }
+    ++descriptors.handles;
+    state.isInodeShared = true;
+    state.inode = key;
+    state.fd = descriptors.fd;
+    state.directFd = isDirect ? descriptors.directFd : -1;
+    return true;
+}
+
+static void releaseDescriptors(UringState &state) {
+    if (!state.isInodeShared) {
+        if (state.fd >= 0) {
+            close(state.fd);
+        }
+        return;
+    }
+    lock_guard<mutex> guard(inodesMutex);
+    auto itr = inodeDescriptors.find(state.inode);
+    if (itr != inodeDescriptors.end()) {
+        --itr->second.handles;
+    }
+    pruneDescriptorsLocked();
+}
+
+//endregion
+
+//region Ring
+
+static void releaseWrite(PendingWrite *write) {
+    free(write->io.iov_base);
+    delete write;
+}
+
+static void reapLocked(UringState &state) {
+    auto &ring = state.ring;
+    unsigned head = *ring.completeHead;
+    while (head != __atomic_load_n(ring.completeTail, __ATOMIC_ACQUIRE)) {
+        auto &completion = ring.completions[head & ring.completeMask];
+        auto write = reinterpret_cast<PendingWrite *>(completion.user_data);
+        if (write) {
+            if (completion.res != (int) write->io.iov_len && state.error == SQLITE_OK) {
+                state.error = SQLITE_IOERR_WRITE;
+            }
+            state.pending.remove(write);
+            releaseWrite(write);
+        } else if (completion.res < 0 && state.error == SQLITE_OK) {
+            state.error = SQLITE_IOERR_FSYNC;
+        }
+        --state.inFlight;
+        ++head;
+    }
+    __atomic_store_n(ring.completeHead, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Waits for a submission entry, submitting what is queued and reaping completions until one is free.
+ */
+static io_uring_sqe *nextEntryLocked(UringState &state) {
+    auto entry = state.ring.nextEntry();
+    while (!entry) {
+        if (state.ring.enter(state.unsubmitted, 1) < 0) {
+            return nullptr;
+        }
+        state.unsubmitted = 0;
+        reapLocked(state);
+        entry = state.ring.nextEntry();
+    }
+    return entry;
+}
+
+static int submitQueuedLocked(UringState &state) {
+    for (auto write : state.pending) {
+        if (write->isSubmitted) {
+            continue;
+        }
+        // completions must never outnumber the completion queue
+        while (state.inFlight >= ringEntries) {
+            if (state.ring.enter(state.unsubmitted, 1) < 0) {
+                return SQLITE_IOERR_WRITE;
+            }
+            state.unsubmitted = 0;
+            reapLocked(state);
+        }
+        auto entry = nextEntryLocked(state);
+        if (!entry) {
+            return SQLITE_IOERR_WRITE;
+        }
+        bool isAligned = write->offset % directAlignment == 0 && write->io.iov_len % directAlignment == 0;
+        entry->opcode = IORING_OP_WRITEV;
+        entry->fd = state.directFd >= 0 && isAligned ? state.directFd : state.fd;
+        entry->addr = (unsigned long long) &write->io;
+        entry->len = 1;
+        entry->off = (unsigned long long) write->offset;
+        entry->user_data = (unsigned long long) write;
+        state.ring.push();
+        write->isSubmitted = true;
+        ++state.unsubmitted;
+        ++state.inFlight;
+    }
+    state.queued = 0;
+    if (state.unsubmitted && state.ring.enter(state.unsubmitted, 0) < 0) {
+        return SQLITE_IOERR_WRITE;
+    }
+    state.unsubmitted = 0;
+    return SQLITE_OK;
+}
+
+/**
+ * Submits, and optionally syncs, everything queued and waits for it to complete.
+ */
+static int drainLocked(UringState &state, int syncFlags) {
+    int rc = submitQueuedLocked(state);
+    if (rc == SQLITE_OK && syncFlags) {
+        auto entry = nextEntryLocked(state);
+        if (!entry) {
+            return SQLITE_IOERR_FSYNC;
+        }
+        entry->opcode = IORING_OP_FSYNC;
+        entry->fd = state.fd;
+        // after every write submitted before it
+        entry->flags = IOSQE_IO_DRAIN;
+        entry->fsync_flags = (syncFlags & SQLITE_SYNC_DATAONLY) ? IORING_FSYNC_DATASYNC : 0;
+        entry->user_data = 0;
+        state.ring.push();
+        ++state.inFlight;
+        if (state.ring.enter(1, 0) < 0) {
+            return SQLITE_IOERR_FSYNC;
+        }
+    }
+    while (rc == SQLITE_OK && state.inFlight > 0) {
+        if (state.ring.enter(0, 1) < 0) {
+            return SQLITE_IOERR_WRITE;
+        }
+        reapLocked(state);
+    }
+    state.pendingEnd = 0;
+    if (rc == SQLITE_OK) {
+        rc = state.error;
+    }
+    state.error = SQLITE_OK;
+    return rc;
+}
+
+static int drain(UringState &state, int syncFlags) {
+    lock_guard<mutex> guard(state.stateMutex);
+    return drainLocked(state, syncFlags);
+}
+
+/**
+ * Makes the queued WAL frames of a database visible, before the WAL index refers to them.
+ */
+static void drainWal(string const &databasePath) {
+    lock_guard<mutex> guard(statesMutex);
+    auto itr = openStates.find(databasePath + "-wal");
+    if (itr != openStates.end()) {
+        for (auto state : itr->second) {
+            drain(*state, 0);
+        }
+    }
+}
+
+//endregion
+
+//region sqlite3_io_methods
+
+static UringHandle &handleOf(sqlite3_file *file) {
+    return *reinterpret_cast<UringHandle *>(file);
+}
+
+static int uringClose(sqlite3_file *file) {
+    auto &handle = handleOf(file);
+    auto state = handle.state;
+    int rc = drain(*state, 0);
+    {
+        lock_guard<mutex> guard(statesMutex);
+        auto itr = openStates.find(state->path);
+        if (itr != openStates.end()) {
+            itr->second.erase(state);
+            if (itr->second.empty()) {
+                openStates.erase(itr);
+            }
+        }
+    }
+    state->ring.close();
+    releaseDescriptors(*state);
+    delete state;
+    int closeRc = handle.real->pMethods->xClose(handle.real);
+    return rc == SQLITE_OK ? closeRc : rc;
+}
+
+static int uringRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset) {
+    auto &handle = handleOf(file);
+    auto &state = *handle.state;
+    {
+        lock_guard<mutex> guard(state.stateMutex);
+        for (auto write : state.pending) {
+            if (write->offset < offset + amount && offset < write->offset + (sqlite3_int64) write->io.iov_len) {
+                int rc = drainLocked(state, 0);
+                if (rc != SQLITE_OK) {
+                    return SQLITE_IOERR_READ;
+                }
+                break;
+            }
+        }
+    }
+    return handle.real->pMethods->xRead(handle.real, buffer, amount, offset);
+}
+
+static int uringWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset) {
+    auto &state = *handleOf(file).state;
+    lock_guard<mutex> guard(state.stateMutex);
+    // the writes of the ring complete in any order, sqlite rewrites pages and WAL frames before it syncs
+    for (auto pending : state.pending) {
+        bool isOverlapping = pending->offset < offset + amount &&
+                             offset < pending->offset + (sqlite3_int64) pending->io.iov_len;
+        if (!isOverlapping) {
+            continue;
+        }
+        if (!pending->isSubmitted && pending->offset == offset && pending->io.iov_len == (size_t) amount) {
+            memcpy(pending->io.iov_base, buffer, (size_t) amount);
+            return SQLITE_OK;
+        }
+        int rc = drainLocked(state, 0);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        break;
+    }
+
+    void *copy = nullptr;
+    if (posix_memalign(&copy, directAlignment, (size_t) amount) != 0) {
+        return SQLITE_IOERR_NOMEM;
+    }
+    memcpy(copy, buffer, (size_t) amount);
+    auto write = new PendingWrite();
+    write->offset = offset;
+    write->io.iov_base = copy;
+    write->io.iov_len = (size_t) amount;
+    state.pending.push_back(write);
+    state.pendingEnd = max(state.pendingEnd, offset + amount);
+    if (++state.queued >= submitBatch) {
+        return submitQueuedLocked(state);
+    }
+    return SQLITE_OK;
+}
+
+static int uringTruncate(sqlite3_file *file, sqlite3_int64 size) {
+    auto &handle = handleOf(file);
+    int rc = drain(*handle.state, 0);
+    return rc == SQLITE_OK ? handle.real->pMethods->xTruncate(handle.real, size) : rc;
+}
+
+static int uringSync(sqlite3_file *file, int flags) {
+    auto &handle = handleOf(file);
+    auto &state = *handle.state;
+    lock_guard<mutex> guard(state.stateMutex);
+    int rc = drainLocked(state, flags | SQLITE_SYNC_NORMAL);
+    if (rc == SQLITE_OK && !state.isSynced) {
+        // the wrapped vfs also syncs the directory of a new file
+        rc = handle.real->pMethods->xSync(handle.real, flags);
+        state.isSynced = true;
+    }
+    return rc;
+}
+
+static int uringFileSize(sqlite3_file *file, sqlite3_int64 *size) {
+    auto &handle = handleOf(file);
+    int rc = handle.real->pMethods->xFileSize(handle.real, size);
+    lock_guard<mutex> guard(handle.state->stateMutex);
+    *size = max(*size, handle.state->pendingEnd);
+    return rc;
+}
+
+static int uringLock(sqlite3_file *file, int lock) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xLock(real, lock);
+}
+
+static int uringUnlock(sqlite3_file *file, int lock) {
+    auto &handle = handleOf(file);
+    // other connections see every write once the lock is released
+    int rc = drain(*handle.state, 0);
+    int unlockRc = handle.real->pMethods->xUnlock(handle.real, lock);
+    return rc == SQLITE_OK ? unlockRc : rc;
+}
+
+static int uringCheckReservedLock(sqlite3_file *file, int *isReserved) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xCheckReservedLock(real, isReserved);
+}
+
+static int uringFileControl(sqlite3_file *file, int op, void *arg) {
+    auto &handle = handleOf(file);
+    if (op == SQLITE_FCNTL_SIZE_HINT || op == SQLITE_FCNTL_SYNC) {
+        int rc = drain(*handle.state, 0);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    return handle.real->pMethods->xFileControl(handle.real, op, arg);
+}
+
+static int uringSectorSize(sqlite3_file *file) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xSectorSize(real);
+}
+
+static int uringDeviceCharacteristics(sqlite3_file *file) {
+    auto real = handleOf(file).real;
+    // queued writes may complete in any order
+    return real->pMethods->xDeviceCharacteristics(real) & ~SQLITE_IOCAP_SEQUENTIAL;
+}
+
+static int uringShmMap(sqlite3_file *file, int region, int regionSize, int isWrite, void volatile **address) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xShmMap(real, region, regionSize, isWrite, address);
+}
+
+static int uringShmLock(sqlite3_file *file, int offset, int n, int flags) {
+    auto &handle = handleOf(file);
+    drainWal(handle.state->path);
+    return handle.real->pMethods->xShmLock(handle.real, offset, n, flags);
+}
+
+static void uringShmBarrier(sqlite3_file *file) {
+    auto &handle = handleOf(file);
+    // the WAL index header is about to refer to the frames just written
+    drainWal(handle.state->path);
+    handle.real->pMethods->xShmBarrier(handle.real);
+}
+
+static int uringShmUnmap(sqlite3_file *file, int deleteFlag) {
+    auto real = handleOf(file).real;
+    return real->pMethods->xShmUnmap(real, deleteFlag);
+}
+
+// version 2, queued writes would not be seen through memory mapped pages
+static const sqlite3_io_methods uringMethods = {
+        2,
+        uringClose,
+        uringRead,
+        uringWrite,
+        uringTruncate,
+        uringSync,
+        uringFileSize,
+        uringLock,
+        uringUnlock,
+        uringCheckReservedLock,
+        uringFileControl,
+        uringSectorSize,
+        uringDeviceCharacteristics,
+        uringShmMap,
+        uringShmLock,
+        uringShmBarrier,
+        uringShmUnmap,
+        nullptr,
+        nullptr,
+};
+
+//endregion
+
+//region sqlite3_vfs
+
+static int uringOpen(sqlite3_vfs *vfs, const char *path, sqlite3_file *file, int flags, int *outFlags) {
+    // a ring costs a setup and three mappings, rollback journals go to the wrapped vfs, see MadUringVfs
+    int queuedFiles = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_WAL;
+    if (!path || !(flags & queuedFiles) || (flags & SQLITE_OPEN_READONLY)) {
+        return rootVfs->xOpen(rootVfs, path, file, flags, outFlags);
+    }
+    auto &handle = handleOf(file);
+    handle.base.pMethods = nullptr;
+    handle.real = reinterpret_cast<sqlite3_file *>(&handle + 1);
+    int rc = rootVfs->xOpen(rootVfs, path, handle.real, flags, outFlags);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (handle.real->pMethods->iVersion < 2) {
+        handle.real->pMethods->xClose(handle.real);
+        return SQLITE_CANTOPEN;
+    }
+    auto state = new UringState();
+    state->path = path;
+    // descriptors for the ring, the wrapped vfs keeps its own for reads and locks. sqlite locks main database files
+    // only, WAL files have descriptors of their own
+    bool hasDescriptors;
+    if (flags & SQLITE_OPEN_MAIN_DB) {
+        hasDescriptors = acquireDescriptors(*state, vfs == &directVfs);
+    } else {
+        state->fd = open(path, O_WRONLY | O_CLOEXEC);
+        hasDescriptors = state->fd >= 0;
+    }
+    if (!hasDescriptors || !state->ring.open(ringEntries)) {
+        if (hasDescriptors) {
+            releaseDescriptors(*state);
+        }
+        delete state;
+        handle.real->pMethods->xClose(handle.real);
+        return SQLITE_CANTOPEN;
+    }
+    {
+        lock_guard<mutex> guard(statesMutex);
+        openStates[state->path].insert(state);
+    }
+    handle.state = state;
+    handle.base.pMethods = &uringMethods;
+    return SQLITE_OK;
+}
+
+//endregion
+
+//region MadUringVfs
+
+bool MadUringVfs::ensureInstalled() {
+    lock_guard<mutex> guard(installMutex);
+    if (isInstalled) {
+        return isAvailable;
+    }
+    isInstalled = true;
+    Ring probe;
+    if (!probe.open(2)) {
+        return false;
+    }
+    probe.close();
+    rootVfs = sqlite3_vfs_find(nullptr);
+    if (!rootVfs) {
+        return false;
+    }
+    // everything but opening files is the wrapped vfs
+    uringVfs = *rootVfs;
+    uringVfs.pNext = nullptr;
+    uringVfs.zName = name;
+    uringVfs.szOsFile = (int) sizeof(UringHandle) + rootVfs->szOsFile;
+    uringVfs.xOpen = uringOpen;
+    directVfs = uringVfs;
+    directVfs.zName = directName;
+    isAvailable = sqlite3_vfs_register(&uringVfs, 0) == SQLITE_OK &&
+                  sqlite3_vfs_register(&directVfs, 0) == SQLITE_OK;
+    return isAvailable;
+}
+
+//endregion
+
+#endif
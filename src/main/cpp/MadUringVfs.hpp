@@ -0,0 +1,41 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_MADURINGVFS_HPP
+#define PROJECT_MADURINGVFS_HPP
+
+namespace madsqlite {
+
+/**
+ * A Linux sqlite vfs wrapping the default vfs which queues the writes of database and WAL files and submits them
+ * in batches through an io_uring, followed by an fsync through the same ring when sqlite syncs. Writes are made
+ * visible to readers before sqlite unlocks a file, publishes WAL frames or reads what they cover, a write
+ * overlapping a queued one replaces it or waits for it to complete. Rollback journals, opened and deleted or
+ * truncated by every commit, are written through the default vfs rather than set up a ring each.
+ *
+ * With direct I/O, page aligned writes of main database files bypass the operating system's cache (O_DIRECT), reads
+ * remain cached.
+ */
+class MadUringVfs {
+
+public:
+
+    /**
+     * The names the vfs is registered with, without and with direct I/O.
+     */
+    static const char *const name;
+    static const char *const directName;
+
+    /**
+     * Registers the vfs unless it is already registered.
+     *
+     * @return false if io_uring is unavailable, databases are then opened with the default vfs.
+     */
+    static bool ensureInstalled();
+
+};
+
+}
+
+#endif //PROJECT_MADURINGVFS_HPP
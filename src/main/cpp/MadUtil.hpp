@@ -2,9 +2,14 @@
 // Created by William Kamp on 10/15/16.
 //
 
+#ifndef PROJECT_MADUTIL_HPP
+#define PROJECT_MADUTIL_HPP
+
 #include <string>
+#include <functional>
 #include <limits.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 namespace madsqlite {
 
@@ -28,22 +33,45 @@ namespace madsqlite {
         return lowerCaseString(str.c_str());
     }
 
-    static std::string getAbsoluteFilePath(std::string const &filePath) {
-        std::string absolutePath;
+    /**
+     * Identifies a file regardless of the path used to reach it.
+     */
+    struct FileKey {
+        unsigned long long device = 0;
+        unsigned long long inode = 0;
+        // platforms without inode numbers identify files by their absolute path instead
+        std::string path;
+
+        bool operator==(FileKey const &other) const {
+            return device == other.device && inode == other.inode && path == other.path;
+        }
+    };
+
+    struct FileKeyHash {
+        size_t operator()(FileKey const &key) const {
+            return std::hash<unsigned long long>()(key.inode * 31 + key.device) ^ std::hash<std::string>()(key.path);
+        }
+    };
+
+    static bool getFileKey(std::string const &filePath, FileKey &key) {
 #ifdef _WIN32
         char absolute[_MAX_PATH];
-        if (_fullpath(absolute, filePath.c_str(), _MAX_PATH))
-            absolute_path = absolute;
-#elif defined(__linux__) || defined(__sun) || defined(__hpux) || defined(__GNUC__)
-        char *absolute = realpath(filePath.c_str(), nullptr);
-        if (absolute) {
-            absolutePath = absolute;
+        if (!_fullpath(absolute, filePath.c_str(), _MAX_PATH)) {
+            return false;
         }
-        free(absolute);
+        key.path = absolute;
+        return true;
 #else
-#error Platform absolute path function needed
+        struct stat info;
+        if (stat(filePath.c_str(), &info) != 0) {
+            return false;
+        }
+        key.device = (unsigned long long) info.st_dev;
+        key.inode = (unsigned long long) info.st_ino;
+        return true;
 #endif
-        return absolutePath;
     }
 
-}
\ No newline at end of file
+}
+
+#endif //PROJECT_MADUTIL_HPP
\ No newline at end of file
@@ -0,0 +1,598 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadVfs.hpp"
+#include "sqlite3.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace madsqlite;
+using namespace std;
+
+namespace {
+
+/**
+ * The I/O counters of one path, kept after the file is closed.
+ */
+struct FileCounters {
+    atomic<long long> reads{0};
+    atomic<long long> writes{0};
+    atomic<long long> syncs{0};
+    atomic<long long> bytesRead{0};
+    atomic<long long> bytesWritten{0};
+    atomic<long long> readAheads{0};
+    atomic<long long> cacheHits{0};
+};
+
+/**
+ * The state of an open file, owned by its ShimFile.
+ */
+struct FileState {
+    string path;
+    bool isMainDb = false;
+    shared_ptr<FileCounters> counters;
+    sqlite3_int64 nextSequentialOffset = -1;
+    int sequentialReads = 0;
+    sqlite3_int64 readAheadEnd = 0;
+    // the read ahead descriptor belongs to the inode table, see acquireReadAhead
+    int readAheadFd = -1;
+    pair<dev_t, ino_t> inode;
+};
+
+/**
+ * The descriptor the operating system is asked to read a main database file ahead through.
+ */
+struct InodeReadAhead {
+    int fd = -1;
+    int handles = 0;
+};
+
+/**
+ * The sqlite3_file of the shim, followed in memory by the sqlite3_file of the wrapped vfs.
+ */
+struct ShimFile {
+    sqlite3_file base;
+    sqlite3_file *real;
+    FileState *state;
+};
+
+struct CachedPage {
+    string path;
+    sqlite3_int64 offset;
+    vector<char> data;
+};
+
+/**
+ * Pages of database files read through the shim, shared by every connection and evicted least recently used first.
+ */
+class PageCache {
+
+private:
+
+    // sqlite pages are at most 64 KiB
+    static const sqlite3_int64 maxPageSize = 65536;
+
+    mutex cacheMutex;
+    list<CachedPage> pages;
+    map<pair<string, sqlite3_int64>, list<CachedPage>::iterator> index;
+    size_t bytes = 0;
+    size_t capacity = 0;
+
+    void evict() {
+        while (bytes > capacity && !pages.empty()) {
+            auto &page = pages.back();
+            bytes -= page.data.size();
+            index.erase(make_pair(page.path, page.offset));
+            pages.pop_back();
+        }
+    }
+
+public:
+
+    void setCapacity(size_t cacheCapacity) {
+        lock_guard<mutex> guard(cacheMutex);
+        capacity = cacheCapacity;
+        evict();
+    }
+
+    bool read(string const &path, void *buffer, int amount, sqlite3_int64 offset) {
+        lock_guard<mutex> guard(cacheMutex);
+        auto itr = index.find(make_pair(path, offset));
+        if (itr == index.end() || itr->second->data.size() < (size_t) amount) {
+            return false;
+        }
+        memcpy(buffer, itr->second->data.data(), (size_t) amount);
+        pages.splice(pages.begin(), pages, itr->second);
+        return true;
+    }
+
+    void put(string const &path, const void *buffer, int amount, sqlite3_int64 offset) {
+        lock_guard<mutex> guard(cacheMutex);
+        if ((size_t) amount > capacity) {
+            return;
+        }
+        auto key = make_pair(path, offset);
+        auto itr = index.find(key);
+        if (itr != index.end()) {
+            if (itr->second->data.size() >= (size_t) amount) {
+                return;
+            }
+            bytes -= itr->second->data.size();
+            pages.erase(itr->second);
+            index.erase(itr);
+        }
+        auto data = static_cast<const char *>(buffer);
+        pages.push_front(CachedPage{path, offset, vector<char>(data, data + amount)});
+        index[key] = pages.begin();
+        bytes += amount;
+        evict();
+    }
+
+    /**
+     * Drops the cached pages of a path overlapping the range [begin, end).
+     */
+    void invalidate(string const &path, sqlite3_int64 begin, sqlite3_int64 end) {
+        lock_guard<mutex> guard(cacheMutex);
+        auto itr = index.lower_bound(make_pair(path, begin - maxPageSize));
+        while (itr != index.end() && itr->first.first == path && itr->first.second < end) {
+            auto page = itr->second;
+            if (page->offset + (sqlite3_int64) page->data.size() > begin) {
+                bytes -= page->data.size();
+                pages.erase(page);
+                itr = index.erase(itr);
+            } else {
+                ++itr;
+            }
+        }
+    }
+};
+
+}
+
+static mutex vfsMutex;
+static bool isInstalled = false;
+static sqlite3_vfs shimVfs;
+static sqlite3_vfs *rootVfs = nullptr;
+static atomic<bool> isReadAhead{true};
+static atomic<int> readAheadPages{64};
+static PageCache pageCache;
+static map<string, shared_ptr<FileCounters>> fileCounters;
+// closing any descriptor of a file drops the POSIX locks every connection of the process holds on it, so like the
+// descriptors of MadUringVfs the read ahead descriptors are shared by inode and kept while the file exists
+static mutex inodesMutex;
+static map<pair<dev_t, ino_t>, InodeReadAhead> inodeReadAheads;
+
+const char *const MadVfs::name = "madsqlite";
+
+static shared_ptr<FileCounters> countersFor(string const &path) {
+    lock_guard<mutex> guard(vfsMutex);
+    auto &counters = fileCounters[path];
+    if (!counters) {
+        counters = make_shared<FileCounters>();
+    }
+    return counters;
+}
+
+static sqlite3_file *realFile(sqlite3_file *file) {
+    return reinterpret_cast<ShimFile *>(file)->real;
+}
+
+static FileState &fileState(sqlite3_file *file) {
+    return *reinterpret_cast<ShimFile *>(file)->state;
+}
+
+//region Read ahead
+
+/**
+ * Closes the descriptors of deleted files no handle uses, no other process can open and lock those.
+ */
+static void pruneReadAheadsLocked() {
+#ifndef _WIN32
+    for (auto itr = inodeReadAheads.begin(); itr != inodeReadAheads.end();) {
+        struct stat info;
+        if (itr->second.handles == 0 && fstat(itr->second.fd, &info) == 0 && info.st_nlink == 0) {
+            close(itr->second.fd);
+            itr = inodeReadAheads.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+#endif
+}
+
+/**
+ * Sets the read ahead descriptor of a main database file, shared with the other handles of the file.
+ */
+static void acquireReadAhead(FileState &state) {
+#ifndef _WIN32
+    lock_guard<mutex> guard(inodesMutex);
+    pruneReadAheadsLocked();
+    struct stat info;
+    if (stat(state.path.c_str(), &info) != 0) {
+        return;
+    }
+    auto key = make_pair(info.st_dev, info.st_ino);
+    auto itr = inodeReadAheads.find(key);
+    if (itr == inodeReadAheads.end()) {
+        int fd = open(state.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat opened;
+        if (fstat(fd, &opened) != 0) {
+            close(fd);
+            return;
+        }
+        if (opened.st_dev != info.st_dev || opened.st_ino != info.st_ino) {
+            // the file was replaced since the stat, the descriptor stays with the inode it refers to
+            auto &replaced = inodeReadAheads[make_pair(opened.st_dev, opened.st_ino)];
+            if (replaced.fd < 0) {
+                replaced.fd = fd;
+            } else {
+                close(fd);
+            }
+            return;
+        }
+        itr = inodeReadAheads.emplace(key, InodeReadAhead()).first;
+        itr->second.fd = fd;
+    }
+    ++itr->second.handles;
+    state.readAheadFd = itr->second.fd;
+    state.inode = key;
+#endif
+}
+
+static void releaseReadAhead(FileState &state) {
+    if (state.readAheadFd < 0) {
+        return;
+    }
+    lock_guard<mutex> guard(inodesMutex);
+    auto itr = inodeReadAheads.find(state.inode);
+    if (itr != inodeReadAheads.end()) {
+        --itr->second.handles;
+    }
+    pruneReadAheadsLocked();
+}
+
+/**
+ * Asks the operating system to read the pages following a run of sequential reads ahead. Nothing is read on the
+ * querying thread, the pages reach the page cache of the shim when sqlite reads them.
+ */
+static void readAheadIfSequential(FileState &state, int amount, sqlite3_int64 offset) {
+    if (offset == state.nextSequentialOffset) {
+        ++state.sequentialReads;
+    } else {
+        state.sequentialReads = 0;
+    }
+    state.nextSequentialOffset = offset + amount;
+    if (!isReadAhead || state.readAheadFd < 0 || state.sequentialReads < 2 || offset + amount <= state.readAheadEnd) {
+        return;
+    }
+#ifdef POSIX_FADV_WILLNEED
+    sqlite3_int64 begin = max(offset + amount, state.readAheadEnd);
+    sqlite3_int64 length = (sqlite3_int64) readAheadPages * amount;
+    if (posix_fadvise(state.readAheadFd, (off_t) begin, (off_t) length, POSIX_FADV_WILLNEED) != 0) {
+        return;
+    }
+    state.readAheadEnd = begin + length;
+    ++state.counters->readAheads;
+#endif
+}
+
+//endregion
+
+//region sqlite3_io_methods
+
+static int shimClose(sqlite3_file *file) {
+    auto shim = reinterpret_cast<ShimFile *>(file);
+    int rc = shim->real->pMethods ? shim->real->pMethods->xClose(shim->real) : SQLITE_OK;
+    if (shim->state) {
+        releaseReadAhead(*shim->state);
+    }
+    delete shim->state;
+    shim->state = nullptr;
+    return rc;
+}
+
+static int shimRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset) {
+    auto &state = fileState(file);
+    ++state.counters->reads;
+    state.counters->bytesRead += amount;
+    if (state.isMainDb && pageCache.read(state.path, buffer, amount, offset)) {
+        ++state.counters->cacheHits;
+        return SQLITE_OK;
+    }
+    auto real = realFile(file);
+    int rc = real->pMethods->xRead(real, buffer, amount, offset);
+    if (rc == SQLITE_OK && state.isMainDb) {
+        pageCache.put(state.path, buffer, amount, offset);
+        readAheadIfSequential(state, amount, offset);
+    }
+    return rc;
+}
+
+static int shimWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset) {
+    auto &state = fileState(file);
+    ++state.counters->writes;
+    state.counters->bytesWritten += amount;
+    if (state.isMainDb) {
+        pageCache.invalidate(state.path, offset, offset + amount);
+    }
+    auto real = realFile(file);
+    return real->pMethods->xWrite(real, buffer, amount, offset);
+}
+
+static int shimTruncate(sqlite3_file *file, sqlite3_int64 size) {
+    auto &state = fileState(file);
+    if (state.isMainDb) {
+        pageCache.invalidate(state.path, size, numeric_limits<sqlite3_int64>::max());
+    }
+    auto real = realFile(file);
+    return real->pMethods->xTruncate(real, size);
+}
+
+static int shimSync(sqlite3_file *file, int flags) {
+    ++fileState(file).counters->syncs;
+    auto real = realFile(file);
+    return real->pMethods->xSync(real, flags);
+}
+
+static int shimFileSize(sqlite3_file *file, sqlite3_int64 *size) {
+    auto real = realFile(file);
+    return real->pMethods->xFileSize(real, size);
+}
+
+static int shimLock(sqlite3_file *file, int lock) {
+    auto real = realFile(file);
+    return real->pMethods->xLock(real, lock);
+}
+
+static int shimUnlock(sqlite3_file *file, int lock) {
+    auto real = realFile(file);
+    return real->pMethods->xUnlock(real, lock);
+}
+
+static int shimCheckReservedLock(sqlite3_file *file, int *isReserved) {
+    auto real = realFile(file);
+    return real->pMethods->xCheckReservedLock(real, isReserved);
+}
+
+static int shimFileControl(sqlite3_file *file, int op, void *arg) {
+    auto real = realFile(file);
+    return real->pMethods->xFileControl(real, op, arg);
+}
+
+static int shimSectorSize(sqlite3_file *file) {
+    auto real = realFile(file);
+    return real->pMethods->xSectorSize(real);
+}
+
+static int shimDeviceCharacteristics(sqlite3_file *file) {
+    auto real = realFile(file);
+    return real->pMethods->xDeviceCharacteristics(real);
+}
+
+static int shimShmMap(sqlite3_file *file, int region, int regionSize, int isWrite, void volatile **address) {
+    auto real = realFile(file);
+    if (real->pMethods->iVersion < 2) {
+        return SQLITE_IOERR;
+    }
+    return real->pMethods->xShmMap(real, region, regionSize, isWrite, address);
+}
+
+static int shimShmLock(sqlite3_file *file, int offset, int n, int flags) {
+    auto real = realFile(file);
+    if (real->pMethods->iVersion < 2) {
+        return SQLITE_IOERR;
+    }
+    return real->pMethods->xShmLock(real, offset, n, flags);
+}
+
+static void shimShmBarrier(sqlite3_file *file) {
+    auto real = realFile(file);
+    if (real->pMethods->iVersion >= 2) {
+        real->pMethods->xShmBarrier(real);
+    }
+}
+
+static int shimShmUnmap(sqlite3_file *file, int deleteFlag) {
+    auto real = realFile(file);
+    if (real->pMethods->iVersion < 2) {
+        return SQLITE_OK;
+    }
+    return real->pMethods->xShmUnmap(real, deleteFlag);
+}
+
+static int shimFetch(sqlite3_file *file, sqlite3_int64 offset, int amount, void **page) {
+    auto real = realFile(file);
+    if (real->pMethods->iVersion < 3) {
+        *page = nullptr;
+        return SQLITE_OK;
+    }
+    auto &state = fileState(file);
+    ++state.counters->reads;
+    state.counters->bytesRead += amount;
+    return real->pMethods->xFetch(real, offset, amount, page);
+}
+
+static int shimUnfetch(sqlite3_file *file, sqlite3_int64 offset, void *page) {
+    auto real = realFile(file);
+    if (real->pMethods->iVersion < 3) {
+        return SQLITE_OK;
+    }
+    return real->pMethods->xUnfetch(real, offset, page);
+}
+
+static const sqlite3_io_methods shimMethods = {
+        3,
+        shimClose,
+        shimRead,
+        shimWrite,
+        shimTruncate,
+        shimSync,
+        shimFileSize,
+        shimLock,
+        shimUnlock,
+        shimCheckReservedLock,
+        shimFileControl,
+        shimSectorSize,
+        shimDeviceCharacteristics,
+        shimShmMap,
+        shimShmLock,
+        shimShmBarrier,
+        shimShmUnmap,
+        shimFetch,
+        shimUnfetch,
+};
+
+//endregion
+
+//region sqlite3_vfs
+
+static int shimOpen(sqlite3_vfs *, const char *path, sqlite3_file *file, int flags, int *outFlags) {
+    auto shim = reinterpret_cast<ShimFile *>(file);
+    shim->base.pMethods = nullptr;
+    shim->real = reinterpret_cast<sqlite3_file *>(shim + 1);
+    shim->state = nullptr;
+    int rc = rootVfs->xOpen(rootVfs, path, shim->real, flags, outFlags);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    auto state = new FileState();
+    state->path = path ? path : "";
+    state->isMainDb = (flags & SQLITE_OPEN_MAIN_DB) != 0;
+    state->counters = countersFor(state->path);
+    if (state->isMainDb) {
+        acquireReadAhead(*state);
+    }
+    shim->state = state;
+    shim->base.pMethods = &shimMethods;
+    return SQLITE_OK;
+}
+
+static int shimDelete(sqlite3_vfs *, const char *path, int syncDir) {
+    return rootVfs->xDelete(rootVfs, path, syncDir);
+}
+
+static int shimAccess(sqlite3_vfs *, const char *path, int flags, int *result) {
+    return rootVfs->xAccess(rootVfs, path, flags, result);
+}
+
+static int shimFullPathname(sqlite3_vfs *, const char *path, int size, char *out) {
+    return rootVfs->xFullPathname(rootVfs, path, size, out);
+}
+
+static void *shimDlOpen(sqlite3_vfs *, const char *path) {
+    return rootVfs->xDlOpen(rootVfs, path);
+}
+
+static void shimDlError(sqlite3_vfs *, int size, char *message) {
+    rootVfs->xDlError(rootVfs, size, message);
+}
+
+static void (*shimDlSym(sqlite3_vfs *, void *handle, const char *symbol))(void) {
+    return rootVfs->xDlSym(rootVfs, handle, symbol);
+}
+
+static void shimDlClose(sqlite3_vfs *, void *handle) {
+    rootVfs->xDlClose(rootVfs, handle);
+}
+
+static int shimRandomness(sqlite3_vfs *, int size, char *out) {
+    return rootVfs->xRandomness(rootVfs, size, out);
+}
+
+static int shimSleep(sqlite3_vfs *, int micros) {
+    return rootVfs->xSleep(rootVfs, micros);
+}
+
+static int shimCurrentTime(sqlite3_vfs *, double *time) {
+    return rootVfs->xCurrentTime(rootVfs, time);
+}
+
+static int shimGetLastError(sqlite3_vfs *, int size, char *message) {
+    return rootVfs->xGetLastError ? rootVfs->xGetLastError(rootVfs, size, message) : 0;
+}
+
+static int shimCurrentTimeInt64(sqlite3_vfs *, sqlite3_int64 *time) {
+    return rootVfs->xCurrentTimeInt64(rootVfs, time);
+}
+
+//endregion
+
+//region MadVfs
+
+static bool installLocked(MadDatabase::VfsOptions const &options) {
+    isReadAhead = options.readAhead;
+    readAheadPages = max(options.readAheadPages, 1);
+    pageCache.setCapacity(options.pageCacheBytes);
+    if (isInstalled) {
+        return true;
+    }
+    rootVfs = sqlite3_vfs_find(nullptr);
+    if (!rootVfs) {
+        return false;
+    }
+    shimVfs.iVersion = min(rootVfs->iVersion, 2);
+    shimVfs.szOsFile = (int) sizeof(ShimFile) + rootVfs->szOsFile;
+    shimVfs.mxPathname = rootVfs->mxPathname;
+    shimVfs.zName = MadVfs::name;
+    shimVfs.xOpen = shimOpen;
+    shimVfs.xDelete = shimDelete;
+    shimVfs.xAccess = shimAccess;
+    shimVfs.xFullPathname = shimFullPathname;
+    shimVfs.xDlOpen = rootVfs->xDlOpen ? shimDlOpen : nullptr;
+    shimVfs.xDlError = rootVfs->xDlError ? shimDlError : nullptr;
+    shimVfs.xDlSym = rootVfs->xDlSym ? shimDlSym : nullptr;
+    shimVfs.xDlClose = rootVfs->xDlClose ? shimDlClose : nullptr;
+    shimVfs.xRandomness = shimRandomness;
+    shimVfs.xSleep = shimSleep;
+    shimVfs.xCurrentTime = shimCurrentTime;
+    shimVfs.xGetLastError = shimGetLastError;
+    shimVfs.xCurrentTimeInt64 = rootVfs->iVersion >= 2 ? shimCurrentTimeInt64 : nullptr;
+    isInstalled = sqlite3_vfs_register(&shimVfs, 0) == SQLITE_OK;
+    return isInstalled;
+}
+
+bool MadVfs::install(MadDatabase::VfsOptions const &options) {
+    lock_guard<mutex> guard(vfsMutex);
+    return installLocked(options);
+}
+
+bool MadVfs::ensureInstalled() {
+    lock_guard<mutex> guard(vfsMutex);
+    return isInstalled || installLocked(MadDatabase::VfsOptions());
+}
+
+map<string, MadDatabase::IoStats> MadVfs::getIoStats() {
+    lock_guard<mutex> guard(vfsMutex);
+    map<string, MadDatabase::IoStats> stats;
+    for (auto &&entry : fileCounters) {
+        auto &counters = *entry.second;
+        auto &fileStats = stats[entry.first];
+        fileStats.reads = counters.reads;
+        fileStats.writes = counters.writes;
+        fileStats.syncs = counters.syncs;
+        fileStats.bytesRead = counters.bytesRead;
+        fileStats.bytesWritten = counters.bytesWritten;
+        fileStats.readAheads = counters.readAheads;
+        fileStats.cacheHits = counters.cacheHits;
+    }
+    return stats;
+}
+
+//endregion
@@ -0,0 +1,43 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_MADVFS_HPP
+#define PROJECT_MADVFS_HPP
+
+#include "MadDatabase.hpp"
+#include <map>
+#include <string>
+
+namespace madsqlite {
+
+/**
+ * A sqlite vfs shim wrapping the default vfs which counts the I/O of every file, asks the operating system to read
+ * sequentially accessed database files ahead and keeps an optional page cache shared by every connection.
+ */
+class MadVfs {
+
+public:
+
+    /**
+     * The name the shim is registered with.
+     */
+    static const char *const name;
+
+    /**
+     * Registers the shim, or updates its options when it is already registered.
+     */
+    static bool install(MadDatabase::VfsOptions const &options);
+
+    /**
+     * Registers the shim with the default options unless it is already registered.
+     */
+    static bool ensureInstalled();
+
+    static std::map<std::string, MadDatabase::IoStats> getIoStats();
+
+};
+
+}
+
+#endif //PROJECT_MADVFS_HPP
@@ -0,0 +1,162 @@
+//
+// Created on 10/19/26.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include "MadDatabase.hpp"
+
+using namespace madsqlite;
+using namespace std;
+
+/**
+ * The workload madsqlite is profiled with for profile guided optimization, see the madsqlite-pgo target. It should
+ * resemble how the library is used: transactions of inserts, point queries, scans, full text and spatial searches.
+ */
+
+static const int rowCount = 20000;
+static const char *words[] = {"harbor", "buoy", "channel", "anchorage", "light", "beacon", "wreck", "shoal", "pier",
+                              "marina", "bridge", "lock", "reef", "cape", "bay", "sound"};
+static const int wordCount = sizeof(words) / sizeof(words[0]);
+
+static string sentence(mt19937 &random, int length) {
+    string text;
+    for (int i = 0; i < length; ++i) {
+        if (i) {
+            text += ' ';
+        }
+        text += words[random() % wordCount];
+    }
+    return text;
+}
+
+static void insertRows(MadDatabase &db, mt19937 &random) {
+    db.exec("CREATE TABLE features (id INTEGER PRIMARY KEY, name TEXT, depth REAL, chart BLOB);");
+    db.exec("CREATE INDEX features_name ON features (name);");
+    db.exec("CREATE VIRTUAL TABLE features_text USING fts5 (description);");
+    db.exec("CREATE VIRTUAL TABLE features_bounds USING rtree (id, minX, maxX, minY, maxY);");
+    auto cv = MadContentValues();
+    auto textValues = MadContentValues();
+    auto boundValues = MadContentValues();
+    db.beginTransaction();
+    for (int i = 0; i < rowCount; ++i) {
+        cv.putInteger("id", i);
+        cv.putString("name", sentence(random, 2));
+        cv.putReal("depth", (random() % 10000) / 100.0);
+        cv.putBlob("chart", vector<unsigned char>(random() % 512, (unsigned char) i));
+        db.insert("features", cv);
+
+        textValues.putInteger("rowid", i);
+        textValues.putString("description", sentence(random, 12));
+        db.insert("features_text", textValues);
+
+        double x = random() % 36000 / 100.0 - 180;
+        double y = random() % 18000 / 100.0 - 90;
+        boundValues.putInteger("id", i);
+        boundValues.putReal("minX", x);
+        boundValues.putReal("maxX", x + 0.05);
+        boundValues.putReal("minY", y);
+        boundValues.putReal("maxY", y + 0.05);
+        db.insert("features_bounds", boundValues);
+        if (i % 2000 == 1999) {
+            db.commitTransaction();
+            db.beginTransaction();
+        }
+    }
+    db.commitTransaction();
+    // autocommit inserts
+    for (int i = 0; i < 500; ++i) {
+        cv.putInteger("id", rowCount + i);
+        db.insert("features", cv);
+    }
+    db.exec("UPDATE features SET depth = depth + 1 WHERE id % 7 = 0;");
+}
+
+static long long pointQueries(MadDatabase &db, mt19937 &random) {
+    long long found = 0;
+    for (int i = 0; i < 10000; ++i) {
+        auto query = db.query("SELECT name, depth, chart FROM features WHERE id = ?;", {to_string(random() % rowCount)});
+        if (query.moveToFirst()) {
+            found += query.getString(0).size() + query.getBlob(2).size() + (long long) query.getReal(1);
+        }
+    }
+    for (int i = 0; i < 1000; ++i) {
+        auto query = db.query("SELECT id FROM features WHERE name = ?;", {sentence(random, 2)});
+        for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+            found += query.getInt(0);
+        }
+    }
+    return found;
+}
+
+static long long scans(MadDatabase &db) {
+    long long found = 0;
+    for (int i = 0; i < 5; ++i) {
+        auto query = db.query("SELECT id, name, depth FROM features ORDER BY depth;");
+        for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+            found += query.getInt(0) + query.getString(1).size();
+        }
+        auto aggregate = db.query("SELECT name, count(*), avg(depth) FROM features GROUP BY name;");
+        for (aggregate.moveToFirst(); !aggregate.isAfterLast(); aggregate.moveToNext()) {
+            found += aggregate.getInt(1);
+        }
+    }
+    return found;
+}
+
+static long long textSearches(MadDatabase &db, mt19937 &random) {
+    long long found = 0;
+    for (int i = 0; i < 200; ++i) {
+        auto match = "\"" + sentence(random, 3) + "\"";
+        auto query = db.query("SELECT rowid, snippet(features_text, 0, '[', ']', '...', 4) FROM features_text "
+                              "WHERE features_text MATCH ? ORDER BY rank LIMIT 20;", {match});
+        for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+            found += query.getString(1).size();
+        }
+    }
+    return found;
+}
+
+static long long spatialSearches(MadDatabase &db, mt19937 &random) {
+    long long found = 0;
+    for (int i = 0; i < 1000; ++i) {
+        double x = random() % 36000 / 100.0 - 180;
+        double y = random() % 18000 / 100.0 - 90;
+        auto query = db.query("SELECT f.id, f.name FROM features_bounds b JOIN features f ON f.id = b.id "
+                              "WHERE b.maxX >= ? AND b.minX <= ? AND b.maxY >= ? AND b.minY <= ?;",
+                              {to_string(x), to_string(x + 2), to_string(y), to_string(y + 2)});
+        for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+            found += query.getInt(0);
+        }
+    }
+    return found;
+}
+
+static long long runWorkload(MadDatabase &db) {
+    mt19937 random(42);
+    insertRows(db, random);
+    return pointQueries(db, random) + scans(db) + textSearches(db, random) + spatialSearches(db, random);
+}
+
+int main() {
+    auto start = chrono::steady_clock::now();
+    long long found = 0;
+    {
+        auto db = MadDatabase::openInMemoryDatabase();
+        found += runWorkload(*db);
+    }
+    {
+        remove("pgo_workload_db.s3db");
+        auto db = MadDatabase::openDatabase("pgo_workload_db.s3db");
+        db->exec("PRAGMA journal_mode=WAL;");
+        found += runWorkload(*db);
+    }
+    remove("pgo_workload_db.s3db");
+    remove("pgo_workload_db.s3db-wal");
+    remove("pgo_workload_db.s3db-shm");
+    auto millis = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    cout << "workload done in " << millis << " ms (" << found << ")" << endl;
+    return 0;
+}
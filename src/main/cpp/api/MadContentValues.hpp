@@ -31,6 +31,14 @@ public:
      */
     MadContentValues();
 
+    /**
+     * Create a new content value container whose text and blob values are copied into one buffer of arenaBytes,
+     * emptied by clear() and grown when a row does not fit. Rows refilled after clear() then allocate nothing.
+     *
+     * @param arenaBytes the initial size of the buffer of the text and blob values.
+     */
+    explicit MadContentValues(size_t arenaBytes);
+
     virtual ~MadContentValues();
 
     /**
@@ -75,7 +83,7 @@ public:
     void putBlob(std::string const &key, const void *value, size_t sz);
 
     /**
-     * Removes all values.
+     * Removes all values, keeping the memory of their keys and data for the values put next.
      */
     void clear();
 };
@@ -10,6 +10,9 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <future>
+#include <map>
 
 namespace madsqlite {
 
@@ -28,17 +31,582 @@ private:
 
 public:
 
+    /**
+     * Locking behavior of a transaction begun with MadDatabase::beginTransaction.
+     */
+    enum class TransactionMode {
+        /**
+         * No lock is acquired until the database is first read or written (the sqlite default).
+         */
+        DEFERRED,
+
+        /**
+         * A write lock is acquired immediately. Other connections may continue to read.
+         */
+        IMMEDIATE,
+
+        /**
+         * An exclusive lock is acquired immediately. Other connections may neither read nor write.
+         */
+        EXCLUSIVE,
+    };
+
+    /**
+     * Invoked when an operation finds the database locked by another connection.
+     * Receives the number of times it has already been invoked for the same lock and returns true to retry.
+     */
+    typedef std::function<bool(int retryCount)> BusyHandler;
+
+    /**
+     * Counters describing time spent waiting on database locks and the use of lookaside memory.
+     */
+    struct Metrics {
+
+        /**
+         * The number of times a locked operation was retried.
+         */
+        long long busyRetries;
+
+        /**
+         * The number of locked operations that were given up on.
+         */
+        long long busyTimeouts;
+
+        /**
+         * The total time spent in the busy handler in microseconds.
+         */
+        long long busyWaitMicros;
+
+        /**
+         * The number of allocations of the writing connection served from its lookaside memory.
+         */
+        long long lookasideHits;
+
+        /**
+         * The number of allocations of the writing connection that did not fit or found its lookaside memory full.
+         */
+        long long lookasideMisses;
+
+        /**
+         * The number of operations which waited for another thread's operation or transaction on the writing
+         * connection.
+         */
+        long long lockWaits;
+
+        /**
+         * The total time operations waited for the writing connection in microseconds.
+         */
+        long long lockWaitMicros;
+    };
+
+    /**
+     * The journal_mode of an opened database, see https://sqlite.org/pragma.html#pragma_journal_mode
+     */
+    enum class JournalMode {
+        DEFAULT,
+        DELETE,
+        TRUNCATE,
+        PERSIST,
+        MEMORY,
+        WAL,
+        OFF,
+    };
+
+    /**
+     * The synchronous setting of an opened database, see https://sqlite.org/pragma.html#pragma_synchronous
+     */
+    enum class Synchronous {
+        DEFAULT,
+        OFF,
+        NORMAL,
+        FULL,
+        EXTRA,
+    };
+
+    /**
+     * Where an opened database keeps temporary tables and indices, see https://sqlite.org/pragma.html#pragma_temp_store
+     */
+    enum class TempStore {
+        DEFAULT,
+        FILE,
+        MEMORY,
+    };
+
+    /**
+     * The locking_mode of an opened database, see https://sqlite.org/pragma.html#pragma_locking_mode
+     */
+    enum class LockingMode {
+        DEFAULT,
+        NORMAL,
+        EXCLUSIVE,
+    };
+
+    /**
+     * Settings of the instrumented file system shim. See MadDatabase::installInstrumentedVfs.
+     */
+    struct VfsOptions {
+
+        /**
+         * Whether sequential reads of a database file ask the operating system to read the following pages ahead,
+         * without waiting for them.
+         */
+        bool readAhead = true;
+
+        /**
+         * The number of pages asked to be read ahead once sequential reads are detected.
+         */
+        int readAheadPages = 64;
+
+        /**
+         * The size of the page cache kept by the shim across connections, 0 to disable it. Cached pages are
+         * invalidated by writes through the shim only, enable it only when no other process writes the database.
+         */
+        size_t pageCacheBytes = 0;
+    };
+
+    /**
+     * File I/O counters of one file opened through the instrumented file system shim.
+     */
+    struct IoStats {
+        long long reads = 0;
+        long long writes = 0;
+        long long syncs = 0;
+        long long bytesRead = 0;
+        long long bytesWritten = 0;
+
+        /**
+         * The number of read aheads of the pages following sequential reads.
+         */
+        long long readAheads = 0;
+
+        /**
+         * The number of reads served from the shim's page cache.
+         */
+        long long cacheHits = 0;
+    };
+
+    /**
+     * Settings of the arena page cache. See MadDatabase::installArenaPageCache.
+     */
+    struct PageCacheOptions {
+
+        /**
+         * The size of the arena shared by the page caches of every database.
+         */
+        size_t arenaBytes = 64 * 1024 * 1024;
+
+        /**
+         * The largest database page size held by the arena, pages of larger databases are allocated from the heap
+         * within the size of the arena and the cache_size of their database.
+         */
+        int pageSize = 4096;
+
+        /**
+         * Whether to back the arena with huge pages where the operating system provides them, falling back to
+         * regular pages.
+         */
+        bool hugePages = false;
+    };
+
+    /**
+     * Counters of the arena page cache.
+     */
+    struct PageCacheStats {
+
+        /**
+         * The number of pages the arena holds.
+         */
+        long long capacityPages = 0;
+
+        /**
+         * The number of arena pages in use.
+         */
+        long long usedPages = 0;
+
+        /**
+         * The number of pages allocated from the heap because the arena was exhausted or the page did not fit.
+         */
+        long long heapPages = 0;
+
+        long long hits = 0;
+        long long misses = 0;
+
+        /**
+         * The number of unused pages taken from one cache to be reused by another or the same cache.
+         */
+        long long evictions = 0;
+
+        /**
+         * Whether the arena is backed by huge pages.
+         */
+        bool isHugePages = false;
+    };
+
+    /**
+     * The memory allocator used by sqlite. See MadDatabase::installAllocator.
+     */
+    enum class Allocator {
+        /**
+         * The system malloc (the sqlite default).
+         */
+        SYSTEM,
+
+        /**
+         * Small allocations are recycled through size classed caches local to each thread, larger ones use the
+         * system malloc.
+         */
+        THREAD_CACHE,
+
+        /**
+         * The sqlite buddy allocator over one fixed heap, see https://sqlite.org/malloc.html#memsys5
+         * Requires sqlite built with SQLITE_ENABLE_MEMSYS5.
+         */
+        MEMSYS5,
+    };
+
+    /**
+     * Settings of the memory allocator used by sqlite.
+     */
+    struct AllocatorOptions {
+
+        Allocator allocator = Allocator::SYSTEM;
+
+        /**
+         * The size of the fixed heap of Allocator::MEMSYS5.
+         */
+        size_t heapBytes = 32 * 1024 * 1024;
+
+        /**
+         * The smallest allocation of Allocator::MEMSYS5, a power of two.
+         */
+        int minAllocation = 64;
+
+        /**
+         * The number of blocks of each size class a thread keeps for reuse with Allocator::THREAD_CACHE.
+         */
+        int threadCacheBlocks = 64;
+
+        /**
+         * The default lookaside slot size and count of new connections, 0 keeps the sqlite defaults.
+         * See OpenOptions::lookasideSlotSize.
+         */
+        int lookasideSlotSize = 0;
+        int lookasideSlots = 0;
+    };
+
+    /**
+     * Process wide counters of the memory allocated by sqlite.
+     */
+    struct AllocatorStats {
+        long long memoryUsed = 0;
+        long long memoryHighwater = 0;
+        long long allocations = 0;
+        long long largestAllocation = 0;
+
+        /**
+         * The number of Allocator::THREAD_CACHE allocations served from a thread's cache.
+         */
+        long long threadCacheHits = 0;
+
+        /**
+         * The number of Allocator::THREAD_CACHE allocations passed to the system malloc.
+         */
+        long long threadCacheMisses = 0;
+    };
+
+    /**
+     * How changes to a database preloaded into memory are written back to its file.
+     */
+    enum class WriteBack {
+        /**
+         * Changes are discarded when the database is closed.
+         */
+        NONE,
+
+        /**
+         * Changes are written back when the database is closed.
+         */
+        ON_CLOSE,
+
+        /**
+         * Changes are written back periodically and when the database is closed.
+         */
+        PERIODIC,
+    };
+
+    /**
+     * Connection settings applied when a database is opened, before it is shared with other callers.
+     * Settings left at their DEFAULT (or 0) values keep the sqlite defaults.
+     */
+    struct OpenOptions {
+
+        JournalMode journalMode = JournalMode::DEFAULT;
+
+        Synchronous synchronous = Synchronous::DEFAULT;
+
+        /**
+         * The page cache size, positive values are a number of pages and negative values a number of kibibytes.
+         */
+        int cacheSize = 0;
+
+        /**
+         * The maximum number of bytes of the database file to memory map, 0 disables memory mapping and negative
+         * values keep the sqlite default.
+         */
+        long long mmapSize = -1;
+
+        /**
+         * The page size in bytes, only takes effect when the database is created.
+         */
+        int pageSize = 0;
+
+        TempStore tempStore = TempStore::DEFAULT;
+
+        LockingMode lockingMode = LockingMode::DEFAULT;
+
+        /**
+         * Installs MadDatabase::exponentialBackoff with this timeout when greater than 0.
+         */
+        int busyTimeoutMillis = 0;
+
+        /**
+         * The sqlite3_open_v2 flags, 0 to open for reading and writing and to create the database if needed.
+         */
+        int openFlags = 0;
+
+        /**
+         * Opens an existing database for reading only. Queries of a read only database do not wait on the locks
+         * of the MadDatabase instance and may run concurrently from any number of threads.
+         */
+        bool readOnly = false;
+
+        /**
+         * Opens an existing read only database which nothing will modify for as long as it is open, such as a
+         * prebuilt dataset. File locking and change detection are skipped, see https://sqlite.org/uri.html#uriimmutable
+         * Implies readOnly.
+         */
+        bool immutable = false;
+
+        /**
+         * The number of connections to open to a read only or shared in memory database. Queries of a read only
+         * database are spread across all of them. Queries of a shared in memory database are spread across all but
+         * the one used for writing and see uncommitted changes.
+         */
+        int readerConnections = 1;
+
+        /**
+         * Copies the whole database file into memory when it is opened so that queries never wait on the file
+         * system. The file is only read again when the database is reopened.
+         */
+        bool preload = false;
+
+        /**
+         * The number of threads reading the database file ahead of the copy into memory, 0 to read it only as
+         * it is copied.
+         */
+        int preloadReadAheadThreads = 0;
+
+        /**
+         * How changes to a preloaded database are written back to its file.
+         */
+        WriteBack preloadWriteBack = WriteBack::NONE;
+
+        /**
+         * The interval of WriteBack::PERIODIC write backs.
+         */
+        long long preloadWriteBackMillis = 60000;
+
+        /**
+         * Opens the database through the instrumented file system shim, installing it with the default
+         * VfsOptions if it has not been installed. See MadDatabase::installInstrumentedVfs.
+         */
+        bool instrumentedVfs = false;
+
+        /**
+         * Stores the pages of the database LZ4 compressed, for databases of compressible values read far more than
+         * written. A compressed database can only be opened compressed. Takes precedence over asyncIo and
+         * instrumentedVfs.
+         */
+        bool compressed = false;
+
+        /**
+         * Queues the writes of the database and its WAL and submits them in batches with the following fsync through
+         * io_uring on Linux, rollback journals are written directly. Ignored where io_uring is unavailable. Takes precedence over instrumentedVfs.
+         */
+        bool asyncIo = false;
+
+        /**
+         * With asyncIo, writes database pages with O_DIRECT, bypassing the operating system's cache.
+         */
+        bool directIo = false;
+
+        /**
+         * The size in bytes and number of the lookaside memory slots of each connection, small allocations of a
+         * connection are served from them without locking. 0 keeps the sqlite defaults.
+         * See https://sqlite.org/malloc.html#lookaside
+         */
+        int lookasideSlotSize = 0;
+        int lookasideSlots = 0;
+    };
+
+    /**
+     * Receives the progress of a backup after each step.
+     * Returns false to abort the backup.
+     */
+    typedef std::function<bool(int remainingPages, int totalPages)> BackupProgress;
+
+    /**
+     * Limits on how many transactions are merged into one when group commit is enabled.
+     * See MadDatabase::setGroupCommit.
+     */
+    struct GroupCommitOptions {
+
+        /**
+         * The longest time a commit waits for transactions of other threads to join it, in microseconds.
+         */
+        long long windowMicros = 1000;
+
+        /**
+         * A group is written as soon as it holds this many inserts and statements.
+         */
+        size_t maxRows = 1000;
+
+        /**
+         * A group is written as soon as it holds this many bytes of inserted values.
+         */
+        size_t maxBytes = 1024 * 1024;
+    };
+
+    /**
+     * Thresholds at which the implicit transaction of auto batch mode is committed.
+     * See MadDatabase::setAutoBatch.
+     */
+    struct AutoBatchOptions {
+
+        /**
+         * The batch is committed once it holds this many inserted rows.
+         */
+        size_t maxRows = 1000;
+
+        /**
+         * The batch is committed once it holds this many bytes of inserted values.
+         */
+        size_t maxBytes = 4 * 1024 * 1024;
+
+        /**
+         * The batch is committed once it has been open this long, 0 or less to disable the timer.
+         */
+        long long maxDelayMillis = 100;
+
+        /**
+         * Whether queries commit the batch first. Queries on this database always see the batched rows, enable this
+         * when other connections or processes must see every row inserted before the query.
+         */
+        bool flushOnQuery = false;
+    };
+
+    /**
+     * Creates a busy handler which sleeps with exponentially increasing, jittered delays until the lock is released
+     * or the timeout elapses.
+     *
+     * @param timeoutMillis the total time to wait for a lock before giving up.
+     * @param initialDelayMillis the delay before the first retry.
+     * @param maxDelayMillis the upper bound of a single delay.
+     */
+    static BusyHandler exponentialBackoff(int timeoutMillis, int initialDelayMillis = 1, int maxDelayMillis = 100);
+
+    /**
+     * Installs (or reconfigures) the instrumented file system shim, a sqlite vfs named "madsqlite" wrapping the
+     * default vfs, which counts the I/O of every file, reads sequentially accessed databases ahead and optionally
+     * caches pages across connections. Databases opened with OpenOptions::instrumentedVfs use it.
+     *
+     * @return true if the shim is installed.
+     */
+    static bool installInstrumentedVfs(VfsOptions const &options);
+
+    /**
+     * Installs the instrumented file system shim with the default VfsOptions.
+     */
+    static bool installInstrumentedVfs();
+
+    /**
+     * @return the I/O counters of every file opened through the instrumented file system shim, by path.
+     */
+    static std::map<std::string, IoStats> getIoStats();
+
+    /**
+     * Installs a sqlite page cache which takes the pages of every database from one preallocated arena, so that the
+     * memory held by page caches stays within the arena however many databases are open. Unused pages are evicted
+     * least recently used first across all databases. The cache_size of each database only caps the pages it takes
+     * from the heap, when its pages do not fit the arena or the arena is exhausted by pages sqlite can not give up.
+     * sqlite is shut down and reinitialized, so the page cache is not installed while a database is open.
+     *
+     * @return true if the page cache is installed, false if it already was, a database is open or sqlite refused it.
+     */
+    static bool installArenaPageCache(PageCacheOptions const &options);
+
+    /**
+     * @return the counters of the arena page cache.
+     */
+    static PageCacheStats getPageCacheStats();
+
+    /**
+     * Installs the memory allocator used by sqlite and the default lookaside memory of new connections.
+     * sqlite is shut down and reinitialized, so the allocator is not installed while a database is open.
+     *
+     * @return true if the allocator is installed, false if a database is open or sqlite refused it.
+     */
+    static bool installAllocator(AllocatorOptions const &options);
+
+    /**
+     * @return the process wide counters of the memory allocated by sqlite.
+     */
+    static AllocatorStats getAllocatorStats();
+
     /**
      * Opens a database.
      * @param dbPath the absolute path of the database to open / create.
      */
     static std::shared_ptr<MadDatabase> openDatabase(std::string const &dbPath);
 
+    /**
+     * Opens a database.
+     * When the database is already open the existing instance is returned and the options are not applied.
+     *
+     * @param dbPath the absolute path of the database to open / create.
+     * @param options settings applied to the connection before it is returned.
+     */
+    static std::shared_ptr<MadDatabase> openDatabase(std::string const &dbPath, OpenOptions const &options);
+
     /**
      * Opens an in memory database an in memory database.
      */
     static std::unique_ptr<MadDatabase> openInMemoryDatabase();
 
+    /**
+     * Opens an in memory database.
+     *
+     * @param options settings applied to the connection before it is returned.
+     */
+    static std::unique_ptr<MadDatabase> openInMemoryDatabase(OpenOptions const &options);
+
+    /**
+     * Opens a named in memory database which is shared by every caller opening the same name.
+     * The database exists for as long as it is open.
+     *
+     * @param name the name of the in memory database to open / create.
+     */
+    static std::shared_ptr<MadDatabase> openInMemoryDatabase(std::string const &name);
+
+    /**
+     * Opens a named in memory database which is shared by every caller opening the same name.
+     * When the database is already open the existing instance is returned and the options are not applied.
+     *
+     * @param name the name of the in memory database to open / create.
+     * @param options settings applied to the connections before they are returned.
+     */
+    static std::shared_ptr<MadDatabase> openInMemoryDatabase(std::string const &name, OpenOptions const &options);
+
     /**
      * For internal use.
      * See MadDatabase::openDatabase
@@ -93,8 +661,13 @@ public:
 
     /**
      * Begins a transaction. The changes will be rolled back if any transaction performed without being commited.
+     *
+     * The transaction belongs to the calling thread. Inserts, statements, queries and transactions of other threads
+     * wait until it has been committed or rolled back, so they are never captured by it.
+     *
+     * @param mode when the transaction acquires its database lock.
      */
-    void beginTransaction();
+    void beginTransaction(TransactionMode mode = TransactionMode::DEFERRED);
 
     /**
      * Rolls back a begun transaction.
@@ -103,8 +676,123 @@ public:
 
     /**
      * Commits a previously begun transaction.
+     *
+     * @return true if the transaction was committed.
+     */
+    bool commitTransaction();
+
+    /**
+     * Enables or disables group commit.
+     *
+     * While enabled each thread's transaction is private to that thread: the inserts and statements made between
+     * beginTransaction and commitTransaction are held back and commitTransaction blocks until they have been written
+     * together with the transactions other threads commit within the same window, in a single sqlite transaction.
+     * Each thread's transaction still succeeds or fails on its own. Queries do not see the held back changes of the
+     * calling thread until they are committed.
+     *
+     * @param enabled whether transactions begun from now on are group committed.
+     * @param options limits on the size of a group and how long a commit waits for one to form.
+     */
+    void setGroupCommit(bool enabled, GroupCommitOptions const &options);
+
+    /**
+     * Enables or disables group commit with the default GroupCommitOptions.
+     * See MadDatabase::setGroupCommit(bool, GroupCommitOptions const &).
+     *
+     * @param enabled whether transactions begun from now on are group committed.
+     */
+    void setGroupCommit(bool enabled);
+
+    /**
+     * Enables or disables auto batch mode.
+     *
+     * While enabled, inserts made outside of a transaction are collected into an implicit transaction instead of
+     * each being committed on its own. The batch is committed once it reaches a threshold of the options, on flush,
+     * before any statement is executed or transaction begun, and when the database is closed. Disabling auto batch
+     * mode commits the batch.
+     *
+     * @param enabled whether inserts outside of a transaction are batched.
+     * @param options the thresholds at which a batch is committed.
+     */
+    void setAutoBatch(bool enabled, AutoBatchOptions const &options);
+
+    /**
+     * Enables or disables auto batch mode with the default AutoBatchOptions.
+     * See MadDatabase::setAutoBatch(bool, AutoBatchOptions const &).
+     *
+     * @param enabled whether inserts outside of a transaction are batched.
+     */
+    void setAutoBatch(bool enabled);
+
+    /**
+     * Commits the inserts collected in auto batch mode.
+     *
+     * @return false if the batch could not be committed.
+     */
+    bool flush();
+
+    /**
+     * Retry operations which find the database locked for up to the given time.
+     * Equivalent to setBusyHandler(MadDatabase::exponentialBackoff(milliseconds)).
+     *
+     * @param milliseconds the total time to wait for a lock, 0 or less to fail immediately.
+     */
+    void setBusyTimeout(int milliseconds);
+
+    /**
+     * Sets the handler invoked when an operation finds the database locked by another connection.
+     * Replaces any handler or timeout previously set.
+     *
+     * @param handler the handler to invoke, nullptr to fail immediately with a busy error.
+     */
+    void setBusyHandler(BusyHandler handler);
+
+    /**
+     * @return the lock wait counters accumulated since the database was opened.
+     */
+    Metrics getMetrics();
+
+    /**
+     * Copies this database into a database file while it remains in use.
+     *
+     * The copy is made a few pages at a time. The database is only locked while a step copies its pages, inserts and
+     * statements of other threads proceed between steps. Inserts collected in auto batch mode are committed first.
+     *
+     * @param path the path of the database file to create or replace.
+     * @param pagesPerStep the number of pages copied by each step, 0 or less to copy everything in one step.
+     * @param sleepBetweenStepsMillis the time to pause between steps.
+     * @param progress invoked after each step, nullptr for none.
+     * @return true if the backup completed.
+     */
+    bool backupTo(std::string const &path, int pagesPerStep = 100, int sleepBetweenStepsMillis = 10,
+                  BackupProgress progress = nullptr);
+
+    /**
+     * Copies this database into another open database while both remain in use.
+     * See MadDatabase::backupTo(std::string const &, int, int, BackupProgress).
+     *
+     * @param destination the database to replace the contents of.
+     * @param pagesPerStep the number of pages copied by each step, 0 or less to copy everything in one step.
+     * @param sleepBetweenStepsMillis the time to pause between steps.
+     * @param progress invoked after each step, nullptr for none.
+     * @return true if the backup completed.
+     */
+    bool backupTo(MadDatabase &destination, int pagesPerStep = 100, int sleepBetweenStepsMillis = 10,
+                  BackupProgress progress = nullptr);
+
+    /**
+     * Copies this database into a database file on a background thread.
+     * See MadDatabase::backupTo(std::string const &, int, int, BackupProgress).
+     * Closing the database aborts a backup in progress.
+     *
+     * @param path the path of the database file to create or replace.
+     * @param pagesPerStep the number of pages copied by each step, 0 or less to copy everything in one step.
+     * @param sleepBetweenStepsMillis the time to pause between steps.
+     * @param progress invoked on the background thread after each step, nullptr for none.
+     * @return the eventual result of the backup.
      */
-    void commitTransaction();
+    std::future<bool> backupToAsync(std::string const &path, int pagesPerStep = 100,
+                                    int sleepBetweenStepsMillis = 10, BackupProgress progress = nullptr);
 
 };
 }
@@ -0,0 +1,92 @@
+//
+// Created on 10/19/26.
+//
+
+#include "benchmark/benchmark.h"
+#include "MadDatabase.hpp"
+#include <cstdio>
+#include <random>
+
+using namespace madsqlite;
+using namespace std;
+
+static const int tileCount = 2000;
+static const int tileSize = 16 * 1024;
+
+static string compressionFileName(bool isCompressed) {
+    return isCompressed ? "bench_compressed_db.s3db" : "bench_plain_db.s3db";
+}
+
+static MadDatabase::OpenOptions compressionOptions(bool isCompressed) {
+    MadDatabase::OpenOptions options;
+    options.compressed = isCompressed;
+    return options;
+}
+
+/**
+ * Tiles resembling rendered map tiles: runs of a few colors with some noise.
+ */
+static vector<unsigned char> makeTile(mt19937 &random) {
+    vector<unsigned char> tile(tileSize);
+    size_t i = 0;
+    while (i < tile.size()) {
+        auto run = min(tile.size() - i, (size_t) (random() % 96 + 1));
+        auto color = (unsigned char) (random() % 6);
+        for (size_t j = 0; j < run; ++j) {
+            tile[i + j] = random() % 16 ? color : (unsigned char) random();
+        }
+        i += run;
+    }
+    return tile;
+}
+
+static void createTileDatabase(bool isCompressed) {
+    static bool isCreated[2] = {false, false};
+    if (isCreated[isCompressed]) {
+        return;
+    }
+    auto fileName = compressionFileName(isCompressed);
+    remove(fileName.c_str());
+    auto db = MadDatabase::openDatabase(fileName, compressionOptions(isCompressed));
+    db->exec("CREATE TABLE tiles (keyIdx INTEGER PRIMARY KEY, tile BLOB);");
+    db->beginTransaction();
+    mt19937 random(7);
+    auto cv = MadContentValues();
+    for (int i = 0; i < tileCount; ++i) {
+        cv.putInteger("keyIdx", i);
+        cv.putBlob("tile", makeTile(random));
+        db->insert("tiles", cv);
+    }
+    db->commitTransaction();
+    isCreated[isCompressed] = true;
+}
+
+static long long fileSize(string const &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+/**
+ * Reads random tiles from a plain and a compressed database.
+ */
+static void BM_TileRead(benchmark::State &state) {
+    bool isCompressed = state.range(0) != 0;
+    createTileDatabase(isCompressed);
+    auto db = MadDatabase::openDatabase(compressionFileName(isCompressed), compressionOptions(isCompressed));
+    mt19937 random(11);
+    for (auto _ : state) {
+        auto query = db->query("SELECT tile FROM tiles WHERE keyIdx = ?;", {to_string(random() % tileCount)});
+        query.moveToFirst();
+        benchmark::DoNotOptimize(query.getBlob(0));
+    }
+    state.SetBytesProcessed(state.iterations() * tileSize);
+    state.counters["fileBytes"] = fileSize(compressionFileName(isCompressed));
+    state.SetLabel(isCompressed ? "compressed" : "plain");
+}
+BENCHMARK(BM_TileRead)->Arg(0)->Arg(1);
@@ -0,0 +1,186 @@
+//
+// Created on 10/19/26.
+//
+
+#include "benchmark/benchmark.h"
+#include "MadDatabase.hpp"
+#include <cstdio>
+
+using namespace madsqlite;
+using namespace std;
+
+/**
+ * The benchmarks of this file take the argument 0 for an in memory database and 1 for a file database.
+ */
+
+static const char *coreFileName = "bench_core_db.s3db";
+static const int coreRows = 1000;
+static const string coreText = "the quick brown fox jumps over the lazy dog";
+
+static bool isFileDatabase(benchmark::State const &state) {
+    return state.range(0) != 0;
+}
+
+/**
+ * Opens an empty database with a test table, filled with coreRows rows if asked to.
+ */
+static shared_ptr<MadDatabase> openCoreDatabase(benchmark::State &state, bool isFilled) {
+    shared_ptr<MadDatabase> db;
+    if (isFileDatabase(state)) {
+        remove(coreFileName);
+        remove((string(coreFileName) + "-journal").c_str());
+        db = MadDatabase::openDatabase(coreFileName);
+    } else {
+        db = MadDatabase::openInMemoryDatabase();
+    }
+    db->exec("CREATE TABLE test (keyText TEXT, keyBlob BLOB, keyIdx INTEGER);");
+    if (isFilled) {
+        db->beginTransaction();
+        auto cv = MadContentValues();
+        for (int i = 0; i < coreRows; ++i) {
+            cv.putString("keyText", coreText);
+            cv.putBlob("keyBlob", coreText.data(), coreText.size());
+            cv.putInteger("keyIdx", i);
+            db->insert("test", cv);
+        }
+        db->commitTransaction();
+    }
+    state.SetLabel(isFileDatabase(state) ? "file" : "memory");
+    return db;
+}
+
+//region Inserts
+
+static void BM_InsertAutocommit(benchmark::State &state) {
+    auto db = openCoreDatabase(state, false);
+    auto cv = MadContentValues();
+    long long i = 0;
+    for (auto _ : state) {
+        cv.putString("keyText", coreText);
+        cv.putInteger("keyIdx", i++);
+        benchmark::DoNotOptimize(db->insert("test", cv));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InsertAutocommit)->Arg(0)->Arg(1);
+
+static void BM_InsertTransaction(benchmark::State &state) {
+    auto db = openCoreDatabase(state, false);
+    auto cv = MadContentValues();
+    long long i = 0;
+    db->beginTransaction();
+    for (auto _ : state) {
+        cv.putString("keyText", coreText);
+        cv.putInteger("keyIdx", i++);
+        benchmark::DoNotOptimize(db->insert("test", cv));
+    }
+    db->commitTransaction();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InsertTransaction)->Arg(0)->Arg(1);
+
+static void BM_TransactionBeginCommit(benchmark::State &state) {
+    auto db = openCoreDatabase(state, false);
+    auto cv = MadContentValues();
+    cv.putString("keyText", coreText);
+    for (auto _ : state) {
+        db->beginTransaction();
+        db->insert("test", cv);
+        benchmark::DoNotOptimize(db->commitTransaction());
+    }
+}
+BENCHMARK(BM_TransactionBeginCommit)->Arg(0)->Arg(1);
+
+//endregion
+
+//region Queries
+
+/**
+ * Preparing a query and iterating its rows without reading them.
+ */
+static void BM_QueryIterate(benchmark::State &state) {
+    auto db = openCoreDatabase(state, true);
+    for (auto _ : state) {
+        auto query = db->query("SELECT keyText, keyBlob, keyIdx FROM test WHERE keyIdx < 100;");
+        for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 100);
+}
+BENCHMARK(BM_QueryIterate)->Arg(0)->Arg(1);
+
+static void BM_QueryPrepare(benchmark::State &state) {
+    auto db = openCoreDatabase(state, true);
+    for (auto _ : state) {
+        auto query = db->query("SELECT keyText FROM test WHERE keyIdx = ?;", {"7"});
+        benchmark::DoNotOptimize(query.moveToFirst());
+    }
+}
+BENCHMARK(BM_QueryPrepare)->Arg(0)->Arg(1);
+
+/**
+ * Reading the columns of one row, the cost of the conversion to C++ types.
+ */
+static void BM_GetString(benchmark::State &state) {
+    auto db = openCoreDatabase(state, true);
+    auto query = db->query("SELECT keyText FROM test LIMIT 1;");
+    query.moveToFirst();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(query.getString(0));
+    }
+}
+BENCHMARK(BM_GetString)->Arg(0)->Arg(1);
+
+static void BM_GetBlob(benchmark::State &state) {
+    auto db = openCoreDatabase(state, true);
+    auto query = db->query("SELECT keyBlob FROM test LIMIT 1;");
+    query.moveToFirst();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(query.getBlob(0));
+    }
+}
+BENCHMARK(BM_GetBlob)->Arg(0)->Arg(1);
+
+static void BM_GetInt(benchmark::State &state) {
+    auto db = openCoreDatabase(state, true);
+    auto query = db->query("SELECT keyIdx FROM test LIMIT 1;");
+    query.moveToFirst();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(query.getInt(0));
+    }
+}
+BENCHMARK(BM_GetInt)->Arg(0)->Arg(1);
+
+//endregion
+
+//region Content values and registry
+
+static void BM_ContentValuesPutClear(benchmark::State &state) {
+    auto cv = MadContentValues();
+    for (auto _ : state) {
+        cv.putString("keyText", coreText);
+        cv.putBlob("keyBlob", coreText.data(), coreText.size());
+        cv.putInteger("keyIdx", 42);
+        cv.putReal("keyReal", 4.2);
+        cv.clear();
+    }
+}
+BENCHMARK(BM_ContentValuesPutClear);
+
+/**
+ * Opening a database which is already open, a lookup in the registry of open databases.
+ */
+static void BM_OpenRegistered(benchmark::State &state) {
+    auto db = isFileDatabase(state) ? openCoreDatabase(state, false) : MadDatabase::openInMemoryDatabase("bench_core");
+    state.SetLabel(isFileDatabase(state) ? "file" : "memory");
+    for (auto _ : state) {
+        if (isFileDatabase(state)) {
+            benchmark::DoNotOptimize(MadDatabase::openDatabase(coreFileName));
+        } else {
+            benchmark::DoNotOptimize(MadDatabase::openInMemoryDatabase("bench_core"));
+        }
+    }
+}
+BENCHMARK(BM_OpenRegistered)->Arg(0)->Arg(1);
+
+//endregion
@@ -0,0 +1,369 @@
+//
+// Created on 10/19/26.
+//
+
+#include "DatasetGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+using namespace madsqlite;
+using namespace std;
+
+namespace {
+
+const char *const syllables[] = {"ka", "lo", "mi", "ra", "ne", "to", "su", "bel", "dor", "an", "vi", "que", "ston",
+                                 "mar", "hel", "ro", "ti", "gan", "wen", "os", "lin", "ber", "cha", "fa"};
+const int syllableCount = sizeof(syllables) / sizeof(syllables[0]);
+
+const char *const placeKinds[] = {"Harbor", "Point", "Bay", "Light", "Reef", "Sound", "Marina", "Cove", "Island",
+                                  "Bridge", "Channel", "Anchorage"};
+const int placeKindCount = sizeof(placeKinds) / sizeof(placeKinds[0]);
+
+const int placeCount = 256;
+
+/**
+ * The streams of random numbers of the tables, row n of a table draws from the stream (seed, table, n).
+ */
+enum Stream {
+    PLACES = 1,
+    LOCATIONS,
+    IMAGES,
+    DOCUMENTS,
+    BOUNDS,
+};
+
+/**
+ * A splitmix64 generator, cheap to seed for every row.
+ */
+class RowRandom {
+
+public:
+
+    RowRandom(unsigned long long seed, int stream, long long row) {
+        state = seed * 0x9E3779B97F4A7C15ULL ^ (unsigned long long) stream << 56 ^ (unsigned long long) row;
+        next();
+    }
+
+    unsigned long long next() {
+        unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * Uniform in [0, 1).
+     */
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * Standard normal distribution.
+     */
+    double normal() {
+        double u = uniform();
+        double v = uniform();
+        return sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+    }
+
+    int below(int bound) {
+        return (int) (next() % (unsigned long long) bound);
+    }
+
+private:
+
+    unsigned long long state;
+};
+
+string pseudoWord(RowRandom &random, int syllableCountMin, int syllableCountMax) {
+    int count = syllableCountMin + random.below(syllableCountMax - syllableCountMin + 1);
+    string word;
+    for (int i = 0; i < count; ++i) {
+        word += syllables[random.below(syllableCount)];
+    }
+    return word;
+}
+
+/**
+ * Executes a statement, exec returns the number of changed rows rather than whether it succeeded.
+ */
+bool execute(MadDatabase &db, string const &sql) {
+    db.exec(sql);
+    return db.getError().empty();
+}
+
+string capitalized(string word) {
+    if (!word.empty()) {
+        word[0] = (char) toupper(word[0]);
+    }
+    return word;
+}
+
+}
+
+//region Constructor
+
+DatasetGenerator::DatasetGenerator(Options const &options) : options(options) {
+    // distinct words, shorter ones more frequent as in natural language
+    RowRandom wordRandom(options.seed, DOCUMENTS, -1);
+    vocabulary.reserve((size_t) options.vocabularySize);
+    for (int rank = 0; rank < options.vocabularySize; ++rank) {
+        int maxSyllables = 1 + min(4, (int) log10(rank + 10.0));
+        vocabulary.push_back(pseudoWord(wordRandom, 1, maxSyllables) + (rank >= 1000 ? to_string(rank % 97) : ""));
+    }
+    sort(vocabulary.begin(), vocabulary.end());
+    vocabulary.erase(unique(vocabulary.begin(), vocabulary.end()), vocabulary.end());
+    while ((int) vocabulary.size() < options.vocabularySize) {
+        vocabulary.push_back("word" + to_string(vocabulary.size()));
+    }
+    // a fixed shuffle decouples the rank from the alphabetical order
+    for (size_t i = vocabulary.size() - 1; i > 0; --i) {
+        swap(vocabulary[i], vocabulary[wordRandom.next() % (i + 1)]);
+    }
+
+    // Zipf frequencies with an exponent of 1.07
+    cumulativeFrequency.reserve(vocabulary.size());
+    double total = 0;
+    for (size_t rank = 0; rank < vocabulary.size(); ++rank) {
+        total += 1.0 / pow(rank + 1.0, 1.07);
+        cumulativeFrequency.push_back(total);
+    }
+    for (auto &frequency : cumulativeFrequency) {
+        frequency /= total;
+    }
+
+    // the places locations cluster around, weighted towards mid latitudes
+    RowRandom placeRandom(options.seed, PLACES, 0);
+    for (int i = 0; i < placeCount; ++i) {
+        Location place;
+        place.name = capitalized(pseudoWord(placeRandom, 2, 3));
+        place.latitude = max(-80.0, min(80.0, placeRandom.normal() * 30));
+        place.longitude = placeRandom.uniform() * 360 - 180;
+        places.push_back(place);
+    }
+}
+
+//endregion
+
+//region Rows
+
+DatasetGenerator::Location DatasetGenerator::location(long long row) const {
+    RowRandom random(options.seed, LOCATIONS, row);
+    auto &place = places[random.below(placeCount)];
+    Location location;
+    // a tenth of the locations lie anywhere, the rest near a place
+    if (random.uniform() < 0.1) {
+        location.latitude = asin(random.uniform() * 2 - 1) * 180 / M_PI;
+        location.longitude = random.uniform() * 360 - 180;
+        location.name = capitalized(pseudoWord(random, 2, 3)) + " " + placeKinds[random.below(placeKindCount)];
+    } else {
+        location.latitude = max(-90.0, min(90.0, place.latitude + random.normal() * 0.5));
+        location.longitude = fmod(place.longitude + random.normal() * 0.5 + 540, 360) - 180;
+        location.name = place.name + " " + placeKinds[random.below(placeKindCount)];
+    }
+    location.name += " " + to_string(row % 1000);
+    return location;
+}
+
+vector<unsigned char> DatasetGenerator::image(long long row) const {
+    RowRandom random(options.seed, IMAGES, row);
+    double size = options.blobBytes;
+    switch (options.blobDistribution) {
+        case BlobDistribution::FIXED:
+            break;
+        case BlobDistribution::UNIFORM:
+            size = random.uniform() * 2 * options.blobBytes;
+            break;
+        case BlobDistribution::LOG_NORMAL:
+            size = options.blobBytes * exp(random.normal());
+            break;
+    }
+    auto bytes = (size_t) max(0.0, min((double) options.blobMaxBytes, size));
+    // runs of a few values with noise, about as compressible as a small image
+    vector<unsigned char> image(bytes);
+    size_t i = 0;
+    while (i < bytes) {
+        auto run = min(bytes - i, (size_t) (random.below(64) + 1));
+        auto value = (unsigned char) random.below(8);
+        for (size_t j = 0; j < run; ++j) {
+            image[i + j] = value;
+        }
+        if (random.below(4) == 0) {
+            image[i] = (unsigned char) random.next();
+        }
+        i += run;
+    }
+    return image;
+}
+
+int DatasetGenerator::randomRank(double uniform) const {
+    auto itr = lower_bound(cumulativeFrequency.begin(), cumulativeFrequency.end(), uniform);
+    return (int) min((long) cumulativeFrequency.size() - 1, (long) (itr - cumulativeFrequency.begin()));
+}
+
+string DatasetGenerator::documentTitle(long long row) const {
+    RowRandom random(options.seed, DOCUMENTS, row);
+    return capitalized(vocabulary[randomRank(random.uniform())]) + " " +
+           capitalized(vocabulary[randomRank(random.uniform())]);
+}
+
+string DatasetGenerator::documentBody(long long row) const {
+    RowRandom random(options.seed, DOCUMENTS, row);
+    random.next();
+    random.next();
+    // document lengths vary between half and one and a half times the average
+    int words = max(1, (int) (options.wordsPerDocument * (0.5 + random.uniform())));
+    string body;
+    body.reserve((size_t) words * 8);
+    for (int i = 0; i < words; ++i) {
+        if (i) {
+            body += random.below(12) ? " " : ". ";
+        }
+        body += vocabulary[randomRank(random.uniform())];
+    }
+    return body;
+}
+
+DatasetGenerator::Box DatasetGenerator::box(long long row) const {
+    auto center = location(row);
+    RowRandom random(options.seed, BOUNDS, row);
+    double width = options.boxDegrees * exp(random.normal() * 0.75);
+    double height = options.boxDegrees * exp(random.normal() * 0.75);
+    Box box;
+    box.minX = center.longitude - width / 2;
+    box.maxX = center.longitude + width / 2;
+    box.minY = center.latitude - height / 2;
+    box.maxY = center.latitude + height / 2;
+    return box;
+}
+
+string DatasetGenerator::word(int rank) const {
+    return vocabulary[rank];
+}
+
+//endregion
+
+//region Generation
+
+string DatasetGenerator::signature() const {
+    stringstream ss;
+    ss << "seed=" << options.seed << " rows=" << options.rows << " blob=" << (int) options.blobDistribution << ":"
+       << options.blobBytes << ":" << options.blobMaxBytes << " vocabulary=" << options.vocabularySize
+       << " words=" << options.wordsPerDocument << " box=" << options.boxDegrees;
+    return ss.str();
+}
+
+shared_ptr<MadDatabase> DatasetGenerator::openOrGenerate(string const &path, Options const &options) {
+    DatasetGenerator generator(options);
+    auto db = MadDatabase::openDatabase(path);
+    {
+        auto query = db->query("SELECT value FROM dataset_info WHERE key = 'signature';");
+        if (query.moveToFirst() && query.getString(0) == generator.signature()) {
+            return db;
+        }
+    }
+    db.reset();
+    remove(path.c_str());
+    remove((path + "-journal").c_str());
+    db = MadDatabase::openDatabase(path);
+    cout << "generating dataset " << generator.signature() << " into " << path << endl;
+    if (!generator.generate(*db)) {
+        return nullptr;
+    }
+    return db;
+}
+
+bool DatasetGenerator::generate(MadDatabase &db) const {
+    if (!generateLocations(db) || !generateDocuments(db) || !generateBounds(db)) {
+        return false;
+    }
+    // records the options last, an interrupted generation is repeated
+    if (!execute(db, "CREATE TABLE dataset_info (key TEXT PRIMARY KEY, value TEXT);")) {
+        return false;
+    }
+    auto cv = MadContentValues();
+    cv.putString("key", "signature");
+    cv.putString("value", signature());
+    return db.insert("dataset_info", cv);
+}
+
+bool DatasetGenerator::generateLocations(MadDatabase &db) const {
+    if (!execute(db, "CREATE TABLE location_table(name TEXT, latitude REAL, longitude REAL, image BLOB);")) {
+        return false;
+    }
+    auto cv = MadContentValues();
+    db.beginTransaction();
+    for (long long row = 0; row < options.rows; ++row) {
+        auto value = location(row);
+        cv.putString("name", value.name);
+        cv.putReal("latitude", value.latitude);
+        cv.putReal("longitude", value.longitude);
+        cv.putBlob("image", image(row));
+        if (!db.insert("location_table", cv)) {
+            db.rollbackTransaction();
+            return false;
+        }
+        if ((row + 1) % options.batchRows == 0) {
+            db.commitTransaction();
+            db.beginTransaction();
+        }
+    }
+    db.commitTransaction();
+    // indexes built after loading are faster to create and more compact
+    return execute(db, "CREATE INDEX location_name ON location_table (name);") &&
+           execute(db, "CREATE INDEX location_position ON location_table (latitude, longitude);");
+}
+
+bool DatasetGenerator::generateDocuments(MadDatabase &db) const {
+    if (!execute(db, "CREATE VIRTUAL TABLE documents USING fts5 (title, body);")) {
+        return false;
+    }
+    auto cv = MadContentValues();
+    db.beginTransaction();
+    for (long long row = 0; row < options.rows; ++row) {
+        cv.putString("title", documentTitle(row));
+        cv.putString("body", documentBody(row));
+        if (!db.insert("documents", cv)) {
+            db.rollbackTransaction();
+            return false;
+        }
+        if ((row + 1) % options.batchRows == 0) {
+            db.commitTransaction();
+            db.beginTransaction();
+        }
+    }
+    db.commitTransaction();
+    return execute(db, "INSERT INTO documents (documents) VALUES ('optimize');");
+}
+
+bool DatasetGenerator::generateBounds(MadDatabase &db) const {
+    if (!execute(db, "CREATE VIRTUAL TABLE bounds USING rtree (id, minX, maxX, minY, maxY);")) {
+        return false;
+    }
+    auto cv = MadContentValues();
+    db.beginTransaction();
+    for (long long row = 0; row < options.rows; ++row) {
+        auto value = box(row);
+        cv.putInteger("id", row + 1);
+        cv.putReal("minX", value.minX);
+        cv.putReal("maxX", value.maxX);
+        cv.putReal("minY", value.minY);
+        cv.putReal("maxY", value.maxY);
+        if (!db.insert("bounds", cv)) {
+            db.rollbackTransaction();
+            return false;
+        }
+        if ((row + 1) % options.batchRows == 0) {
+            db.commitTransaction();
+            db.beginTransaction();
+        }
+    }
+    db.commitTransaction();
+    return true;
+}
+
+//endregion
@@ -0,0 +1,140 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_DATASETGENERATOR_HPP
+#define PROJECT_DATASETGENERATOR_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "MadDatabase.hpp"
+
+namespace madsqlite {
+
+/**
+ * Generates realistic datasets of any size for benchmarks, the same for the same options:
+ *
+ *  - location_table (name TEXT, latitude REAL, longitude REAL, image BLOB), the table of Main.cpp, with locations
+ *    clustered around places and images of a configurable size distribution, indexed by name and latitude.
+ *  - documents, an FTS5 table (title, body) of text with the word frequencies of natural language (Zipf).
+ *  - bounds, an RTree (id, minX, maxX, minY, maxY) of the bounding boxes of the locations, id is the location rowid.
+ *
+ * Every row is generated from the seed and its number alone, so benchmarks can compute the values of any row to
+ * query for. Row n of each table has the rowid n + 1.
+ */
+class DatasetGenerator {
+
+public:
+
+    enum class BlobDistribution {
+        FIXED,
+        UNIFORM,
+        LOG_NORMAL,
+    };
+
+    struct Options {
+
+        unsigned long long seed = 1;
+
+        /**
+         * The number of rows of each table.
+         */
+        long long rows = 100000;
+
+        /**
+         * The image sizes: blobBytes for FIXED, between 0 and 2 * blobBytes for UNIFORM, a median of blobBytes with
+         * a spread of a factor e for LOG_NORMAL. No image is larger than blobMaxBytes.
+         */
+        BlobDistribution blobDistribution = BlobDistribution::LOG_NORMAL;
+        int blobBytes = 1024;
+        int blobMaxBytes = 64 * 1024;
+
+        /**
+         * The number of distinct words of the documents and the average words per document.
+         */
+        int vocabularySize = 20000;
+        int wordsPerDocument = 40;
+
+        /**
+         * The median edge length of the bounding boxes.
+         */
+        double boxDegrees = 0.01;
+
+        /**
+         * The rows inserted per transaction.
+         */
+        int batchRows = 50000;
+    };
+
+    struct Location {
+        std::string name;
+        double latitude;
+        double longitude;
+    };
+
+    struct Box {
+        double minX;
+        double maxX;
+        double minY;
+        double maxY;
+    };
+
+    explicit DatasetGenerator(Options const &options);
+
+    /**
+     * Opens the database file, generating the dataset into it unless it already holds the dataset of these options.
+     */
+    static std::shared_ptr<MadDatabase> openOrGenerate(std::string const &path, Options const &options);
+
+    /**
+     * Creates the tables and inserts the rows of the dataset.
+     *
+     * @return false if a table could not be created or a row not inserted.
+     */
+    bool generate(MadDatabase &db) const;
+
+    /**
+     * A text identifying the options, equal for equal datasets.
+     */
+    std::string signature() const;
+
+    //region Rows
+
+    Location location(long long row) const;
+
+    std::vector<unsigned char> image(long long row) const;
+
+    std::string documentTitle(long long row) const;
+
+    std::string documentBody(long long row) const;
+
+    Box box(long long row) const;
+
+    /**
+     * The word of the vocabulary at a frequency rank, 0 is the most frequent.
+     */
+    std::string word(int rank) const;
+
+    //endregion
+
+private:
+
+    Options options;
+    std::vector<std::string> vocabulary;
+    std::vector<double> cumulativeFrequency;
+    std::vector<Location> places;
+
+    int randomRank(double uniform) const;
+
+    bool generateLocations(MadDatabase &db) const;
+
+    bool generateDocuments(MadDatabase &db) const;
+
+    bool generateBounds(MadDatabase &db) const;
+
+};
+
+}
+
+#endif //PROJECT_DATASETGENERATOR_HPP
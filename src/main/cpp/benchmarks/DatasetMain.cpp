@@ -0,0 +1,64 @@
+//
+// Created on 10/19/26.
+//
+
+#include "DatasetGenerator.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+using namespace madsqlite;
+using namespace std;
+
+/**
+ * Generates a dataset into a database file:
+ *
+ *   madsqlite-dataset <file> [--rows=100000] [--seed=1] [--blob=lognormal|uniform|fixed] [--blob-bytes=1024]
+ *                     [--blob-max-bytes=65536] [--vocabulary=20000] [--words=40] [--box-degrees=0.01]
+ */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cout << "usage: " << argv[0] << " <file> [--rows=100000] [--seed=1] [--blob=lognormal|uniform|fixed]"
+             << " [--blob-bytes=1024] [--blob-max-bytes=65536] [--vocabulary=20000] [--words=40]"
+             << " [--box-degrees=0.01]" << endl;
+        return 1;
+    }
+    DatasetGenerator::Options options;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        auto separator = arg.find('=');
+        auto name = arg.substr(0, separator);
+        auto value = separator == string::npos ? string() : arg.substr(separator + 1);
+        if (name == "--rows") {
+            options.rows = atoll(value.c_str());
+        } else if (name == "--seed") {
+            options.seed = strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--blob") {
+            options.blobDistribution = value == "fixed" ? DatasetGenerator::BlobDistribution::FIXED :
+                                       value == "uniform" ? DatasetGenerator::BlobDistribution::UNIFORM :
+                                       DatasetGenerator::BlobDistribution::LOG_NORMAL;
+        } else if (name == "--blob-bytes") {
+            options.blobBytes = atoi(value.c_str());
+        } else if (name == "--blob-max-bytes") {
+            options.blobMaxBytes = atoi(value.c_str());
+        } else if (name == "--vocabulary") {
+            options.vocabularySize = atoi(value.c_str());
+        } else if (name == "--words") {
+            options.wordsPerDocument = atoi(value.c_str());
+        } else if (name == "--box-degrees") {
+            options.boxDegrees = atof(value.c_str());
+        } else {
+            cout << "unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    auto start = chrono::steady_clock::now();
+    auto db = DatasetGenerator::openOrGenerate(argv[1], options);
+    if (!db) {
+        cout << "could not generate the dataset" << endl;
+        return 1;
+    }
+    auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << options.rows << " rows per table ready in " << seconds << " s" << endl;
+    return 0;
+}
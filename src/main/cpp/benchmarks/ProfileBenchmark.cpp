@@ -0,0 +1,83 @@
+//
+// Created on 10/19/26.
+//
+
+#include "benchmark/benchmark.h"
+#include "MadDatabase.hpp"
+#include <cstdio>
+
+using namespace madsqlite;
+using namespace std;
+
+static const char *profileFileName = "bench_profile_db.s3db";
+static const int profileRows = 10000;
+
+/**
+ * Creates the benchmark database once per process.
+ */
+static void createProfileDatabase() {
+    static bool isCreated = false;
+    if (isCreated) {
+        return;
+    }
+    remove(profileFileName);
+    auto db = MadDatabase::openDatabase(profileFileName);
+    db->exec("CREATE TABLE test (keyText TEXT, keyReal REAL, keyIdx INTEGER PRIMARY KEY);");
+    db->beginTransaction();
+    auto cv = MadContentValues();
+    for (int i = 0; i < profileRows; ++i) {
+        cv.putString("keyText", "the quick brown fox jumps over the lazy dog");
+        cv.putReal("keyReal", i * 0.5);
+        cv.putInteger("keyIdx", i);
+        db->insert("test", cv);
+    }
+    db->commitTransaction();
+    isCreated = true;
+}
+
+/**
+ * Inserts within one transaction, the statement and allocation heavy path.
+ */
+static void BM_ProfileInsert(benchmark::State &state) {
+    auto db = MadDatabase::openInMemoryDatabase();
+    db->exec("CREATE TABLE test (keyText TEXT, keyReal REAL, keyIdx INTEGER);");
+    db->beginTransaction();
+    auto cv = MadContentValues();
+    long long i = 0;
+    for (auto _ : state) {
+        cv.putString("keyText", "the quick brown fox jumps over the lazy dog");
+        cv.putReal("keyReal", i * 0.5);
+        cv.putInteger("keyIdx", i++);
+        benchmark::DoNotOptimize(db->insert("test", cv));
+    }
+    db->commitTransaction();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProfileInsert);
+
+/**
+ * Full scans reading every column from reader connections, each step and column read takes a connection mutex.
+ */
+static void BM_ProfileScan(benchmark::State &state) {
+    createProfileDatabase();
+    static shared_ptr<MadDatabase> db;
+    if (state.thread_index() == 0) {
+        MadDatabase::OpenOptions options;
+        options.readOnly = true;
+        options.readerConnections = 4;
+        db = MadDatabase::openDatabase(profileFileName, options);
+    }
+    for (auto _ : state) {
+        auto query = db->query("SELECT keyText, keyReal, keyIdx FROM test;");
+        for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+            benchmark::DoNotOptimize(query.getString(0));
+            benchmark::DoNotOptimize(query.getReal(1));
+            benchmark::DoNotOptimize(query.getInt(2));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * profileRows);
+    if (state.thread_index() == 0) {
+        db.reset();
+    }
+}
+BENCHMARK(BM_ProfileScan)->ThreadRange(1, 4)->UseRealTime()->Unit(benchmark::kMillisecond);
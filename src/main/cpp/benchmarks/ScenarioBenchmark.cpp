@@ -0,0 +1,234 @@
+//
+// Created on 10/19/26.
+//
+
+#include "benchmark/benchmark.h"
+#include "DatasetGenerator.hpp"
+#include <cstdlib>
+
+using namespace madsqlite;
+using namespace std;
+
+/**
+ * Query mixes against a generated dataset, see DatasetGenerator. The dataset has MADSQLITE_SCENARIO_ROWS rows per
+ * table (100000 by default) from the seed MADSQLITE_SCENARIO_SEED and is generated once into a file which later runs
+ * reuse, production scale runs set tens of millions of rows.
+ */
+
+static long long environmentNumber(const char *name, long long defaultValue) {
+    auto value = getenv(name);
+    return value ? atoll(value) : defaultValue;
+}
+
+static DatasetGenerator::Options scenarioOptions() {
+    DatasetGenerator::Options options;
+    options.rows = environmentNumber("MADSQLITE_SCENARIO_ROWS", 100000);
+    options.seed = (unsigned long long) environmentNumber("MADSQLITE_SCENARIO_SEED", 1);
+    return options;
+}
+
+static DatasetGenerator &scenarioGenerator() {
+    static DatasetGenerator generator(scenarioOptions());
+    return generator;
+}
+
+static MadDatabase &scenarioDatabase() {
+    static shared_ptr<MadDatabase> db;
+    if (!db) {
+        auto options = scenarioOptions();
+        auto path = "bench_scenario_" + to_string(options.rows) + "_" + to_string(options.seed) + ".s3db";
+        db = DatasetGenerator::openOrGenerate(path, options);
+    }
+    return *db;
+}
+
+//region Queries
+
+static long long nameLookup(MadDatabase &db, long long row) {
+    auto query = db.query("SELECT rowid, latitude, longitude FROM location_table WHERE name = ?;",
+                          {scenarioGenerator().location(row).name});
+    long long rows = 0;
+    for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+        benchmark::DoNotOptimize(query.getReal(1));
+        ++rows;
+    }
+    return rows;
+}
+
+static long long nearby(MadDatabase &db, long long row) {
+    auto center = scenarioGenerator().location(row);
+    auto query = db.query("SELECT name, latitude, longitude FROM location_table "
+                          "WHERE latitude BETWEEN ? AND ? AND longitude BETWEEN ? AND ?;",
+                          {to_string(center.latitude - 0.02), to_string(center.latitude + 0.02),
+                           to_string(center.longitude - 0.02), to_string(center.longitude + 0.02)});
+    long long rows = 0;
+    for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+        benchmark::DoNotOptimize(query.getString(0));
+        ++rows;
+    }
+    return rows;
+}
+
+static long long imageRead(MadDatabase &db, long long row) {
+    auto query = db.query("SELECT image FROM location_table WHERE rowid = ?;", {to_string(row + 1)});
+    if (query.moveToFirst()) {
+        return (long long) query.getBlob(0).size();
+    }
+    return 0;
+}
+
+/**
+ * A full text search for a frequent word (0), a rare word (1) or two words ranked by relevance (2).
+ */
+static long long textSearch(MadDatabase &db, long long row, int kind) {
+    auto &generator = scenarioGenerator();
+    string match;
+    switch (kind) {
+        case 0:
+            match = generator.word((int) (row % 10));
+            break;
+        case 1:
+            match = generator.word((int) (1000 + row % 1000));
+            break;
+        default:
+            match = generator.word((int) (row % 50)) + " AND " + generator.word((int) (50 + row % 500));
+            break;
+    }
+    auto query = db.query("SELECT rowid, snippet(documents, 1, '[', ']', '...', 8) FROM documents "
+                          "WHERE documents MATCH ? ORDER BY rank LIMIT 10;", {match});
+    long long rows = 0;
+    for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+        benchmark::DoNotOptimize(query.getString(1));
+        ++rows;
+    }
+    return rows;
+}
+
+static long long spatialWindow(MadDatabase &db, long long row) {
+    auto center = scenarioGenerator().location(row);
+    auto query = db.query("SELECT l.name FROM bounds b JOIN location_table l ON l.rowid = b.id "
+                          "WHERE b.maxX >= ? AND b.minX <= ? AND b.maxY >= ? AND b.minY <= ?;",
+                          {to_string(center.longitude - 0.1), to_string(center.longitude + 0.1),
+                           to_string(center.latitude - 0.1), to_string(center.latitude + 0.1)});
+    long long rows = 0;
+    for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+        benchmark::DoNotOptimize(query.getString(0));
+        ++rows;
+    }
+    return rows;
+}
+
+//endregion
+
+//region Benchmarks
+
+/**
+ * Random rows in a fixed order, the same for every run.
+ */
+static long long scenarioRow(long long iteration) {
+    static const auto rows = (unsigned long long) scenarioOptions().rows;
+    return (long long) ((unsigned long long) iteration * 2654435761ULL % rows);
+}
+
+static void BM_ScenarioNameLookup(benchmark::State &state) {
+    auto &db = scenarioDatabase();
+    long long iteration = 0, rows = 0;
+    for (auto _ : state) {
+        rows += nameLookup(db, scenarioRow(iteration++));
+    }
+    state.counters["rows"] = benchmark::Counter((double) rows, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ScenarioNameLookup);
+
+static void BM_ScenarioNearby(benchmark::State &state) {
+    auto &db = scenarioDatabase();
+    long long iteration = 0, rows = 0;
+    for (auto _ : state) {
+        rows += nearby(db, scenarioRow(iteration++));
+    }
+    state.counters["rows"] = benchmark::Counter((double) rows, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ScenarioNearby);
+
+static void BM_ScenarioImageRead(benchmark::State &state) {
+    auto &db = scenarioDatabase();
+    long long iteration = 0, bytes = 0;
+    for (auto _ : state) {
+        bytes += imageRead(db, scenarioRow(iteration++));
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_ScenarioImageRead);
+
+static void BM_ScenarioTextSearch(benchmark::State &state) {
+    auto &db = scenarioDatabase();
+    long long iteration = 0, rows = 0;
+    for (auto _ : state) {
+        rows += textSearch(db, scenarioRow(iteration++), (int) state.range(0));
+    }
+    state.counters["rows"] = benchmark::Counter((double) rows, benchmark::Counter::kAvgIterations);
+    state.SetLabel(state.range(0) == 0 ? "frequent" : state.range(0) == 1 ? "rare" : "two words");
+}
+BENCHMARK(BM_ScenarioTextSearch)->Arg(0)->Arg(1)->Arg(2);
+
+static void BM_ScenarioSpatialWindow(benchmark::State &state) {
+    auto &db = scenarioDatabase();
+    long long iteration = 0, rows = 0;
+    for (auto _ : state) {
+        rows += spatialWindow(db, scenarioRow(iteration++));
+    }
+    state.counters["rows"] = benchmark::Counter((double) rows, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ScenarioSpatialWindow);
+
+/**
+ * The mix of an application browsing a map: mostly lookups by name, nearby locations and their images, some searches.
+ */
+static void BM_ScenarioMixed(benchmark::State &state) {
+    auto &db = scenarioDatabase();
+    long long iteration = 0;
+    for (auto _ : state) {
+        auto row = scenarioRow(iteration);
+        switch (iteration++ % 20) {
+            case 0:
+            case 1:
+                textSearch(db, row, (int) (row % 3));
+                break;
+            case 2:
+                spatialWindow(db, row);
+                break;
+            case 3:
+            case 4:
+            case 5:
+                imageRead(db, row);
+                break;
+            case 6:
+            case 7:
+            case 8:
+            case 9:
+                nearby(db, row);
+                break;
+            default:
+                nameLookup(db, row);
+                break;
+        }
+    }
+}
+BENCHMARK(BM_ScenarioMixed);
+
+/**
+ * Loading a tenth of the dataset into an in memory database, the insert rate at scale.
+ */
+static void BM_ScenarioLoad(benchmark::State &state) {
+    auto options = scenarioOptions();
+    options.rows = max(1LL, options.rows / 10);
+    DatasetGenerator generator(options);
+    for (auto _ : state) {
+        auto db = MadDatabase::openInMemoryDatabase();
+        benchmark::DoNotOptimize(generator.generate(*db));
+    }
+    state.SetItemsProcessed(state.iterations() * options.rows * 3);
+}
+BENCHMARK(BM_ScenarioLoad)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+//endregion
@@ -0,0 +1,306 @@
+//
+// Created on 10/19/26.
+//
+
+#include "MadDatabase.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace madsqlite;
+using namespace std;
+
+/**
+ * A stress test of one database shared by reader threads running point lookups and scans and writer threads running
+ * inserts. Reports the throughput and latency percentiles of every operation type and the time operations waited for
+ * the database lock. Lock waits count the waits for a transaction or operation of another thread in the wrapper only,
+ * query steps and getters serialize inside sqlite's connection mutex uncounted, they show in the latencies instead.
+ * Queries share the writing connection unless --reader-connections is above 1 without --file, writable file
+ * databases have no reader connections.
+ *
+ *   madsqlite-stress [--readers=4] [--writers=1] [--rate=0] [--seconds=10] [--mix=80:10:10] [--rows=100000]
+ *                    [--scan-rows=100] [--file=path] [--reader-connections=1] [--wal]
+ *
+ * --rate is the target of operations per second of all threads, 0 runs every thread as fast as it can. The mix of
+ * point lookups, scans and inserts splits the rate between readers and writers and the reads between point lookups
+ * and scans. Latencies of a rate limited run are measured from when an operation was due, not when it started, so a
+ * stalled thread shows as tail latency rather than a lower rate. Without --file the database is a shared in memory
+ * database.
+ */
+
+//region Options
+
+struct StressOptions {
+    int readers = 4;
+    int writers = 1;
+    double rate = 0;
+    double seconds = 10;
+    int pointWeight = 80;
+    int scanWeight = 10;
+    int insertWeight = 10;
+    int rows = 100000;
+    int scanRows = 100;
+    string file;
+    int readerConnections = 1;
+    bool isWal = false;
+};
+
+static bool parseOption(string const &arg, string const &name, string &value) {
+    auto prefix = "--" + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+static bool parseOptions(int argc, char **argv, StressOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        string value;
+        if (parseOption(arg, "readers", value)) {
+            options.readers = atoi(value.c_str());
+        } else if (parseOption(arg, "writers", value)) {
+            options.writers = atoi(value.c_str());
+        } else if (parseOption(arg, "rate", value)) {
+            options.rate = atof(value.c_str());
+        } else if (parseOption(arg, "seconds", value)) {
+            options.seconds = atof(value.c_str());
+        } else if (parseOption(arg, "mix", value)) {
+            if (sscanf(value.c_str(), "%d:%d:%d", &options.pointWeight, &options.scanWeight,
+                       &options.insertWeight) != 3) {
+                return false;
+            }
+        } else if (parseOption(arg, "rows", value)) {
+            options.rows = atoi(value.c_str());
+        } else if (parseOption(arg, "scan-rows", value)) {
+            options.scanRows = atoi(value.c_str());
+        } else if (parseOption(arg, "file", value)) {
+            options.file = value;
+        } else if (parseOption(arg, "reader-connections", value)) {
+            options.readerConnections = atoi(value.c_str());
+        } else if (arg == "--wal") {
+            options.isWal = true;
+        } else {
+            return false;
+        }
+    }
+    return options.readers >= 0 && options.writers >= 0 && options.readers + options.writers > 0 &&
+           options.pointWeight >= 0 && options.scanWeight >= 0 && options.insertWeight >= 0 &&
+           options.seconds > 0 && options.rows > 0;
+}
+
+//endregion
+
+//region Operations
+
+enum class Operation {
+    POINT,
+    SCAN,
+    INSERT,
+};
+
+static const char *operationNames[] = {"point", "scan", "insert"};
+
+/**
+ * The latencies in nanoseconds one thread measured of each operation type.
+ */
+struct Latencies {
+    vector<long long> byOperation[3];
+};
+
+static const string stressText = "the quick brown fox jumps over the lazy dog";
+
+static shared_ptr<MadDatabase> openStressDatabase(StressOptions const &options) {
+    MadDatabase::OpenOptions openOptions;
+    openOptions.readerConnections = options.readerConnections;
+    if (options.isWal) {
+        openOptions.journalMode = MadDatabase::JournalMode::WAL;
+    }
+    shared_ptr<MadDatabase> db;
+    if (options.file.empty()) {
+        db = MadDatabase::openInMemoryDatabase("madsqlite-stress", openOptions);
+    } else {
+        remove(options.file.c_str());
+        db = MadDatabase::openDatabase(options.file, openOptions);
+    }
+    db->exec("CREATE TABLE stress (keyIdx INTEGER PRIMARY KEY, keyText TEXT, keyReal REAL);");
+    db->beginTransaction();
+    auto cv = MadContentValues();
+    for (int i = 0; i < options.rows; ++i) {
+        cv.putInteger("keyIdx", i);
+        cv.putString("keyText", stressText);
+        cv.putReal("keyReal", i * 0.5);
+        db->insert("stress", cv);
+    }
+    db->commitTransaction();
+    return db;
+}
+
+static void runOperation(MadDatabase &db, Operation operation, mt19937 &random, StressOptions const &options,
+                         atomic<long long> &nextKey) {
+    switch (operation) {
+        case Operation::POINT: {
+            auto query = db.query("SELECT keyText, keyReal FROM stress WHERE keyIdx = ?;",
+                                  {to_string(random() % options.rows)});
+            if (query.moveToFirst()) {
+                query.getString(0);
+            }
+            break;
+        }
+        case Operation::SCAN: {
+            auto start = random() % options.rows;
+            auto query = db.query("SELECT keyText, keyReal FROM stress WHERE keyIdx >= ? LIMIT ?;",
+                                  {to_string(start), to_string(options.scanRows)});
+            for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+                query.getReal(1);
+            }
+            break;
+        }
+        case Operation::INSERT: {
+            auto cv = MadContentValues();
+            cv.putInteger("keyIdx", nextKey++);
+            cv.putString("keyText", stressText);
+            cv.putReal("keyReal", 0.5);
+            db.insert("stress", cv);
+            break;
+        }
+    }
+}
+
+/**
+ * Runs operations of the given weights until the deadline, each due interval nanoseconds after the last or at once
+ * when interval is 0.
+ */
+static void runThread(MadDatabase &db, StressOptions const &options, int pointWeight, int scanWeight,
+                      int insertWeight, double interval, chrono::steady_clock::time_point deadline,
+                      unsigned int seed, atomic<long long> &nextKey, Latencies &latencies) {
+    mt19937 random(seed);
+    int totalWeight = pointWeight + scanWeight + insertWeight;
+    auto due = chrono::steady_clock::now();
+    for (long long count = 0;; ++count) {
+        auto now = chrono::steady_clock::now();
+        if (interval > 0) {
+            due += chrono::nanoseconds((long long) interval);
+            if (due > now) {
+                this_thread::sleep_until(due);
+            }
+        } else {
+            due = now;
+        }
+        if (due >= deadline) {
+            break;
+        }
+        int pick = (int) (random() % totalWeight);
+        auto operation = pick < pointWeight ? Operation::POINT :
+                         pick < pointWeight + scanWeight ? Operation::SCAN : Operation::INSERT;
+        runOperation(db, operation, random, options, nextKey);
+        auto latency = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - due).count();
+        latencies.byOperation[(int) operation].push_back(latency);
+    }
+}
+
+//endregion
+
+//region Report
+
+static double percentile(vector<long long> const &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto index = min(sorted.size() - 1, (size_t) (fraction * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+static void report(vector<Latencies> const &threadLatencies, double seconds, MadDatabase::Metrics const &metrics,
+                   StressOptions const &options) {
+    printf("%-8s %10s %12s %10s %10s %10s %10s\n", "op", "count", "ops/s", "p50 us", "p99 us", "p999 us", "max us");
+    long long total = 0;
+    for (int operation = 0; operation < 3; ++operation) {
+        vector<long long> merged;
+        for (auto const &latencies : threadLatencies) {
+            merged.insert(merged.end(), latencies.byOperation[operation].begin(),
+                          latencies.byOperation[operation].end());
+        }
+        if (merged.empty()) {
+            continue;
+        }
+        sort(merged.begin(), merged.end());
+        total += merged.size();
+        printf("%-8s %10zu %12.0f %10.1f %10.1f %10.1f %10.1f\n", operationNames[operation], merged.size(),
+               merged.size() / seconds, percentile(merged, 0.5), percentile(merged, 0.99),
+               percentile(merged, 0.999), merged.back() / 1000.0);
+    }
+    printf("%-8s %10lld %12.0f\n", "total", total, total / seconds);
+    printf("lock waits %lld, %.1f ms total, %.1f us average\n", metrics.lockWaits, metrics.lockWaitMicros / 1000.0,
+           metrics.lockWaits ? (double) metrics.lockWaitMicros / metrics.lockWaits : 0.0);
+    printf("  (waits in the wrapper only, query steps and getters wait inside sqlite uncounted%s)\n",
+           options.readerConnections > 1 && options.file.empty() ? "" : ", queries share the writing connection");
+    printf("busy retries %lld, timeouts %lld, %.1f ms total\n", metrics.busyRetries, metrics.busyTimeouts,
+           metrics.busyWaitMicros / 1000.0);
+}
+
+//endregion
+
+int main(int argc, char **argv) {
+    StressOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        cout << "usage: " << argv[0] << " [--readers=4] [--writers=1] [--rate=0] [--seconds=10] [--mix=80:10:10]"
+             << " [--rows=100000] [--scan-rows=100] [--file=path] [--reader-connections=1] [--wal]" << endl;
+        return 1;
+    }
+    auto db = openStressDatabase(options);
+    auto before = db->getMetrics();
+
+    // readers share the reads and writers the inserts of the target rate
+    int readWeight = options.pointWeight + options.scanWeight;
+    int totalWeight = readWeight + options.insertWeight;
+    double readerInterval = 0;
+    double writerInterval = 0;
+    if (options.rate > 0 && totalWeight > 0) {
+        double readRate = options.rate * readWeight / totalWeight;
+        double insertRate = options.rate * options.insertWeight / totalWeight;
+        readerInterval = readRate > 0 ? 1e9 * options.readers / readRate : 0;
+        writerInterval = insertRate > 0 ? 1e9 * options.writers / insertRate : 0;
+    }
+    if (readWeight == 0) {
+        options.readers = 0;
+    }
+    if (options.insertWeight == 0) {
+        options.writers = 0;
+    }
+
+    atomic<long long> nextKey{options.rows};
+    vector<Latencies> latencies((size_t) (options.readers + options.writers));
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::microseconds((long long) (options.seconds * 1e6));
+    for (int i = 0; i < options.readers + options.writers; ++i) {
+        bool isReader = i < options.readers;
+        threads.emplace_back(runThread, ref(*db), cref(options),
+                             isReader ? options.pointWeight : 0, isReader ? options.scanWeight : 0,
+                             isReader ? 0 : options.insertWeight, isReader ? readerInterval : writerInterval,
+                             deadline, (unsigned int) i + 1, ref(nextKey), ref(latencies[i]));
+    }
+    for (auto &&t : threads) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    auto after = db->getMetrics();
+    after.lockWaits -= before.lockWaits;
+    after.lockWaitMicros -= before.lockWaitMicros;
+    after.busyRetries -= before.busyRetries;
+    after.busyTimeouts -= before.busyTimeouts;
+    after.busyWaitMicros -= before.busyWaitMicros;
+    printf("%d readers, %d writers, %.1f s\n", options.readers, options.writers, seconds);
+    report(latencies, seconds, after, options);
+    return 0;
+}
@@ -0,0 +1,73 @@
+//
+// Created on 10/19/26.
+//
+
+#include "benchmark/benchmark.h"
+#include "MadDatabase.hpp"
+#include <cstdio>
+
+using namespace madsqlite;
+using namespace std;
+
+static const char *warmStartFileName = "bench_warm_start_db.s3db";
+static const int warmStartRows = 100000;
+
+/**
+ * Creates the benchmark database once per process.
+ */
+static void createWarmStartDatabase() {
+    static bool isCreated = false;
+    if (isCreated) {
+        return;
+    }
+    remove(warmStartFileName);
+    auto db = MadDatabase::openDatabase(warmStartFileName);
+    db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER PRIMARY KEY);");
+    db->beginTransaction();
+    auto cv = MadContentValues();
+    for (int i = 0; i < warmStartRows; ++i) {
+        cv.putString("keyText", "the quick brown fox jumps over the lazy dog");
+        cv.putInteger("keyIdx", i);
+        db->insert("test", cv);
+    }
+    db->commitTransaction();
+    isCreated = true;
+}
+
+static MadDatabase::OpenOptions warmStartOptions(bool isWarm) {
+    MadDatabase::OpenOptions options;
+    options.preload = isWarm;
+    options.preloadReadAheadThreads = isWarm ? 4 : 0;
+    return options;
+}
+
+/**
+ * Point queries against a database read from its file (cold) and preloaded into memory (warm).
+ */
+static void BM_PointQuery(benchmark::State &state) {
+    createWarmStartDatabase();
+    auto db = MadDatabase::openDatabase(warmStartFileName, warmStartOptions(state.range(0) != 0));
+    int key = 0;
+    for (auto _ : state) {
+        key = (key + 7919) % warmStartRows;
+        auto query = db->query("SELECT keyText FROM test WHERE keyIdx = ?;", {to_string(key)});
+        benchmark::DoNotOptimize(query.moveToFirst());
+    }
+    state.SetLabel(state.range(0) ? "warm" : "cold");
+}
+BENCHMARK(BM_PointQuery)->Arg(0)->Arg(1);
+
+/**
+ * Opening a database and running a full scan, the cost a warm start pays up front.
+ */
+static void BM_OpenAndScan(benchmark::State &state) {
+    createWarmStartDatabase();
+    for (auto _ : state) {
+        auto db = MadDatabase::openDatabase(warmStartFileName, warmStartOptions(state.range(0) != 0));
+        auto query = db->query("SELECT count(*) FROM test;");
+        query.moveToFirst();
+        benchmark::DoNotOptimize(query.getInt(0));
+    }
+    state.SetLabel(state.range(0) ? "warm" : "cold");
+}
+BENCHMARK(BM_OpenAndScan)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
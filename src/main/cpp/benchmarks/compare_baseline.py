@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+#
+# Created on 10/19/26.
+#
+"""
+Runs madsqlite-bench with repetitions and compares the median times against a baseline, the Google Benchmark JSON
+output of an earlier run on the same class of machine. Fails when a benchmark got slower than the threshold and its
+run to run variation, or when a benchmark of the baseline matching the filter did not run.
+
+    compare_baseline.py --bench <madsqlite-bench> --baseline baselines/<machine>.json [--threshold 10]
+                        [--repetitions 5] [--filter regex] [--require-baseline] [--update]
+
+--update writes the results of the run as the new baseline. Exits with 77, a skipped test for ctest, when there is no
+baseline for the machine, or fails with --require-baseline.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+SKIPPED = 77
+
+TIME_UNITS_NANOS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def run_benchmarks(bench, repetitions, benchmark_filter):
+    handle, out_path = tempfile.mkstemp(suffix=".json")
+    os.close(handle)
+    try:
+        subprocess.check_call([bench,
+                               "--benchmark_filter=" + benchmark_filter,
+                               "--benchmark_repetitions=%d" % repetitions,
+                               "--benchmark_report_aggregates_only=true",
+                               "--benchmark_out=" + out_path,
+                               "--benchmark_out_format=json"],
+                              stdout=subprocess.DEVNULL)
+        with open(out_path) as out:
+            return json.load(out)
+    finally:
+        os.remove(out_path)
+
+
+def medians(results):
+    """
+    The median real time in nanoseconds and the coefficient of variation of every benchmark of a result.
+    """
+    stats = {}
+    for benchmark in results.get("benchmarks", []):
+        if benchmark.get("run_type") != "aggregate":
+            continue
+        name = benchmark.get("run_name", benchmark["name"])
+        entry = stats.setdefault(name, {"median": None, "mean": None, "stddev": None, "cv": None})
+        aggregate = benchmark.get("aggregate_name")
+        if aggregate in entry:
+            unit = TIME_UNITS_NANOS.get(benchmark.get("time_unit", "ns"), 1.0)
+            value = benchmark["real_time"]
+            entry[aggregate] = value if aggregate == "cv" else value * unit
+    for entry in stats.values():
+        if entry["cv"] is None and entry["mean"]:
+            entry["cv"] = (entry["stddev"] or 0.0) / entry["mean"]
+    return {name: entry for name, entry in stats.items() if entry["median"]}
+
+
+def format_time(nanos):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if nanos >= scale:
+            return "%.2f %s" % (nanos / scale, unit)
+    return "%.1f ns" % nanos
+
+
+def compare(baseline, current, threshold):
+    """
+    Prints the changes of the benchmarks in both results and returns the names of the regressed ones and of the
+    baseline ones missing from the current results, a renamed or crashed benchmark must not pass unnoticed.
+    """
+    regressions = []
+    print("%-40s %12s %12s %9s %9s  %s" % ("benchmark", "baseline", "current", "change", "noise", "status"))
+    for name in sorted(set(baseline) | set(current)):
+        if name not in current:
+            print("%-40s %12s %12s %9s %9s  %s" % (name, format_time(baseline[name]["median"]), "-", "-", "-",
+                                                    "MISSING"))
+            regressions.append(name)
+            continue
+        if name not in baseline:
+            print("%-40s %12s %12s %9s %9s  %s" % (name, "-", format_time(current[name]["median"]), "-", "-", "new"))
+            continue
+        before = baseline[name]
+        after = current[name]
+        change = (after["median"] - before["median"]) / before["median"] * 100
+        # two standard deviations of either run
+        noise = 2 * max(before["cv"] or 0.0, after["cv"] or 0.0) * 100
+        status = "ok"
+        if change > max(threshold, noise):
+            status = "REGRESSED"
+            regressions.append(name)
+        elif -change > max(threshold, noise):
+            status = "improved"
+        print("%-40s %12s %12s %+8.1f%% %8.1f%%  %s" % (name, format_time(before["median"]),
+                                                        format_time(after["median"]), change, noise, status))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bench", required=True, help="the madsqlite-bench executable")
+    parser.add_argument("--baseline", required=True, help="the baseline JSON file of this machine class")
+    parser.add_argument("--threshold", type=float, default=10.0, help="percent a median may get slower")
+    parser.add_argument("--repetitions", type=int, default=5, help="runs of every benchmark")
+    parser.add_argument("--filter", default="BM_(Insert|TransactionBeginCommit|Query|Get)",
+                        help="regex of the tracked benchmarks")
+    parser.add_argument("--require-baseline", action="store_true", help="fail rather than skip without a baseline")
+    parser.add_argument("--update", action="store_true", help="write the results as the new baseline")
+    args = parser.parse_args()
+
+    if not args.update and not os.path.exists(args.baseline):
+        print("no baseline %s, create one with --update" % args.baseline)
+        return 1 if args.require_baseline else SKIPPED
+
+    results = run_benchmarks(args.bench, args.repetitions, args.filter)
+    if args.update:
+        directory = os.path.dirname(os.path.abspath(args.baseline))
+        if not os.path.isdir(directory):
+            os.makedirs(directory)
+        with open(args.baseline, "w") as out:
+            json.dump(results, out, indent=2)
+        print("wrote %s" % args.baseline)
+        return 0
+
+    with open(args.baseline) as baseline_file:
+        baseline = medians(json.load(baseline_file))
+    # the benchmarks of the baseline left out by the filter are not expected to run
+    tracked = re.compile(args.filter)
+    baseline = {name: entry for name, entry in baseline.items() if tracked.search(name)}
+    regressions = compare(baseline, medians(results), args.threshold)
+    if regressions:
+        print("%d benchmarks regressed more than %.1f%% or are missing: %s" % (len(regressions), args.threshold,
+                                                                              ", ".join(regressions)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
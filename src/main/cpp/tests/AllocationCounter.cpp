@@ -0,0 +1,128 @@
+//
+// Created on 10/19/26.
+//
+
+#include "AllocationCounter.hpp"
+#include "sqlite3.h"
+#include <cstdlib>
+#include <new>
+
+using namespace madsqlite;
+using namespace std;
+
+namespace {
+
+thread_local long long allocations = 0;
+thread_local long long bytes = 0;
+thread_local long long sqliteAllocations = 0;
+thread_local long long sqliteBytes = 0;
+
+sqlite3_mem_methods defaultMethods;
+
+void *countingMalloc(int size) {
+    ++sqliteAllocations;
+    sqliteBytes += size;
+    return defaultMethods.xMalloc(size);
+}
+
+void *countingRealloc(void *memory, int size) {
+    ++sqliteAllocations;
+    sqliteBytes += size;
+    return defaultMethods.xRealloc(memory, size);
+}
+
+void *allocate(size_t size) {
+    ++allocations;
+    bytes += size;
+    void *memory = malloc(size ? size : 1);
+    if (!memory) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+}
+
+//region Replaced global operator new and delete
+
+void *operator new(size_t size) {
+    return allocate(size);
+}
+
+void *operator new[](size_t size) {
+    return allocate(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    } catch (bad_alloc const &) {
+        return nullptr;
+    }
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    } catch (bad_alloc const &) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    free(memory);
+}
+
+//endregion
+
+//region AllocationCounter
+
+AllocationCounter::Scope::Scope() : start(AllocationCounter::current()) {}
+
+AllocationCounter::Counts AllocationCounter::Scope::delta() const {
+    auto end = AllocationCounter::current();
+    Counts counts;
+    counts.allocations = end.allocations - start.allocations;
+    counts.bytes = end.bytes - start.bytes;
+    counts.sqliteAllocations = end.sqliteAllocations - start.sqliteAllocations;
+    counts.sqliteBytes = end.sqliteBytes - start.sqliteBytes;
+    return counts;
+}
+
+bool AllocationCounter::installSqliteHook() {
+    sqlite3_shutdown();
+    sqlite3_config(SQLITE_CONFIG_GETMALLOC, &defaultMethods);
+    sqlite3_mem_methods methods = defaultMethods;
+    methods.xMalloc = countingMalloc;
+    methods.xRealloc = countingRealloc;
+    bool isInstalled = sqlite3_config(SQLITE_CONFIG_MALLOC, &methods) == SQLITE_OK;
+    return sqlite3_initialize() == SQLITE_OK && isInstalled;
+}
+
+AllocationCounter::Counts AllocationCounter::current() {
+    Counts counts;
+    counts.allocations = allocations;
+    counts.bytes = bytes;
+    counts.sqliteAllocations = sqliteAllocations;
+    counts.sqliteBytes = sqliteBytes;
+    return counts;
+}
+
+string AllocationCounter::describe(string const &name, Counts const &counts) {
+    return name + ": " + to_string(counts.allocations) + " new (" + to_string(counts.bytes) + " B), " +
+           to_string(counts.sqliteAllocations) + " sqlite (" + to_string(counts.sqliteBytes) + " B)";
+}
+
+//endregion
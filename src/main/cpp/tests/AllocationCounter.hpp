@@ -0,0 +1,76 @@
+//
+// Created on 10/19/26.
+//
+
+#ifndef PROJECT_ALLOCATIONCOUNTER_HPP
+#define PROJECT_ALLOCATIONCOUNTER_HPP
+
+#include <string>
+
+namespace madsqlite {
+
+/**
+ * Counts the heap allocations of the calling thread, made through the global operator new, which this library
+ * replaces, and through sqlite's memory allocator once installSqliteHook was called.
+ */
+class AllocationCounter {
+
+public:
+
+    struct Counts {
+
+        /**
+         * The number of allocations through operator new and their bytes.
+         */
+        long long allocations = 0;
+        long long bytes = 0;
+
+        /**
+         * The number of allocations and reallocations of sqlite and their bytes.
+         */
+        long long sqliteAllocations = 0;
+        long long sqliteBytes = 0;
+
+        long long totalAllocations() const {
+            return allocations + sqliteAllocations;
+        }
+    };
+
+    /**
+     * Counts the allocations made between its construction and delta().
+     */
+    class Scope {
+
+    public:
+
+        Scope();
+
+        Counts delta() const;
+
+    private:
+
+        Counts start;
+    };
+
+    /**
+     * Routes sqlite's allocations through the counter, must be called while no database is open.
+     *
+     * @return true if sqlite accepted the allocator.
+     */
+    static bool installSqliteHook();
+
+    /**
+     * The counts of the calling thread since it started.
+     */
+    static Counts current();
+
+    /**
+     * A line of the counts for test output, for example "insert: 12 new (480 B), 5 sqlite (1024 B)".
+     */
+    static std::string describe(std::string const &name, Counts const &counts);
+
+};
+
+}
+
+#endif //PROJECT_ALLOCATIONCOUNTER_HPP
@@ -0,0 +1,125 @@
+//
+// Created on 10/19/26.
+//
+#include <iostream>
+#include "gtest/gtest.h"
+#include "AllocationCounter.hpp"
+#include "MadDatabase.hpp"
+
+using namespace madsqlite;
+using namespace std;
+
+/**
+ * The allocations of each public call, measured warm: the statement or key was used once before. The limits of
+ * operator new are today's counts, lower them when a change saves allocations. The limits of sqlite leave room for
+ * its version and lookaside configuration.
+ */
+
+class SqliteHookEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        ASSERT_TRUE(AllocationCounter::installSqliteHook());
+    }
+};
+
+static ::testing::Environment *const sqliteHookEnvironment =
+        ::testing::AddGlobalTestEnvironment(new SqliteHookEnvironment());
+
+static const string allocationText = "the quick brown fox jumps over the lazy dog";
+static const vector<unsigned char> allocationBlob(64, 7);
+
+template<typename Call>
+static AllocationCounter::Counts measure(string const &name, Call call) {
+    AllocationCounter::Scope scope;
+    call();
+    auto counts = scope.delta();
+    cout << AllocationCounter::describe(name, counts) << endl;
+    return counts;
+}
+
+static void putRow(MadContentValues &cv, long long key) {
+    cv.putString("keyText", allocationText);
+    cv.putInteger("keyIdx", key);
+    cv.putReal("keyReal", 0.5);
+    cv.putBlob("keyBlob", allocationBlob);
+}
+
+static unique_ptr<MadDatabase> openAllocationDatabase() {
+    auto db = MadDatabase::openInMemoryDatabase();
+    db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER, keyReal REAL, keyBlob BLOB);");
+    auto cv = MadContentValues();
+    for (int i = 0; i < 10; ++i) {
+        putRow(cv, i);
+        db->insert("test", cv);
+    }
+    return db;
+}
+
+TEST(MadAllocationTests, ContentValuesPut) {
+    auto cv = MadContentValues();
+    auto newKey = measure("putString new key", [&cv]() { cv.putString("keyText", allocationText); });
+    EXPECT_LE(newKey.allocations, 2);
+    auto existingKey = measure("putString existing key", [&cv]() { cv.putString("keyText", allocationText); });
+    EXPECT_LE(existingKey.allocations, 0);
+    auto integer = measure("putInteger new key", [&cv]() { cv.putInteger("keyIdx", 42); });
+    EXPECT_LE(integer.allocations, 1);
+    auto real = measure("putReal new key", [&cv]() { cv.putReal("keyReal", 0.5); });
+    EXPECT_LE(real.allocations, 1);
+    auto blob = measure("putBlob new key", [&cv]() { cv.putBlob("keyBlob", allocationBlob); });
+    EXPECT_LE(blob.allocations, 1);
+    auto clear = measure("clear", [&cv]() { cv.clear(); });
+    EXPECT_LE(clear.allocations, 0);
+}
+
+TEST(MadAllocationTests, ContentValuesRefill) {
+    auto cv = MadContentValues();
+    putRow(cv, 1);
+    cv.clear();
+    auto refill = measure("clear and refill", [&cv]() { cv.clear(); putRow(cv, 2); });
+    EXPECT_LE(refill.allocations, 0);
+
+    auto arena = MadContentValues(256);
+    auto arenaRefill = measure("arena refill", [&arena]() { arena.clear(); putRow(arena, 3); });
+    EXPECT_LE(arenaRefill.allocations, 3);
+    auto arenaWarm = measure("arena clear and refill", [&arena]() { arena.clear(); putRow(arena, 4); });
+    EXPECT_LE(arenaWarm.allocations, 0);
+}
+
+TEST(MadAllocationTests, Insert) {
+    auto db = openAllocationDatabase();
+    auto cv = MadContentValues();
+    putRow(cv, 100);
+    auto insert = measure("insert 4 columns", [&db, &cv]() { EXPECT_TRUE(db->insert("test", cv)); });
+    EXPECT_LE(insert.allocations, 0);
+    EXPECT_LE(insert.sqliteAllocations, 12);
+}
+
+TEST(MadAllocationTests, QueryAndCursor) {
+    auto db = openAllocationDatabase();
+    {
+        auto warm = db->query("SELECT keyText, keyIdx, keyReal, keyBlob FROM test WHERE keyIdx >= ?;", {"0"});
+        warm.moveToFirst();
+    }
+    AllocationCounter::Scope queryScope;
+    auto query = db->query("SELECT keyText, keyIdx, keyReal, keyBlob FROM test WHERE keyIdx >= ?;", {"0"});
+    auto prepare = queryScope.delta();
+    cout << AllocationCounter::describe("query", prepare) << endl;
+    EXPECT_LE(prepare.allocations, 3);
+    EXPECT_LE(prepare.sqliteAllocations, 60);
+
+    auto first = measure("moveToFirst", [&query]() { EXPECT_TRUE(query.moveToFirst()); });
+    EXPECT_LE(first.allocations, 0);
+    EXPECT_LE(first.sqliteAllocations, 10);
+    auto next = measure("moveToNext", [&query]() { EXPECT_TRUE(query.moveToNext()); });
+    EXPECT_LE(next.allocations, 0);
+    EXPECT_LE(next.sqliteAllocations, 10);
+
+    auto getString = measure("getString", [&query]() { EXPECT_EQ(allocationText, query.getString(0)); });
+    EXPECT_LE(getString.allocations, 1);
+    auto getInt = measure("getInt", [&query]() { EXPECT_EQ(1, query.getInt(1)); });
+    EXPECT_LE(getInt.totalAllocations(), 0);
+    auto getReal = measure("getReal", [&query]() { EXPECT_EQ(0.5, query.getReal(2)); });
+    EXPECT_LE(getReal.totalAllocations(), 0);
+    auto getBlob = measure("getBlob", [&query]() { EXPECT_EQ(allocationBlob, query.getBlob(3)); });
+    EXPECT_LE(getBlob.allocations, 1);
+}
@@ -4,11 +4,19 @@
 #include <iostream>
 #include "gtest/gtest.h"
 #include "MadDatabase.hpp"
+#include "sqlite3.h"
 #include <math.h>
 #include <cstdio>
 #include <thread>
+#include <atomic>
 #include <cstdlib>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace madsqlite;
 using namespace std;
 
@@ -140,6 +148,1221 @@ TEST(MadDatabaseTests, TransactionCommit) {
     EXPECT_FALSE(query.isAfterLast());
 }
 
+TEST(MadDatabaseTests, TransactionImmediateBusy) {
+    string dbFileName = "test_busy_db.s3db";
+    remove(dbFileName.c_str());
+
+    auto db = MadDatabase::openDatabase(dbFileName);
+    db->exec("CREATE TABLE test(keyInt INTEGER);");
+    EXPECT_EQ("", db->getError());
+
+    sqlite3 *other;
+    sqlite3_open(dbFileName.c_str(), &other);
+    sqlite3_exec(other, "BEGIN EXCLUSIVE", nullptr, nullptr, nullptr);
+
+    db->setBusyHandler(MadDatabase::exponentialBackoff(20, 1, 4));
+    db->beginTransaction(MadDatabase::TransactionMode::IMMEDIATE);
+    EXPECT_EQ("database is locked", db->getError());
+
+    auto metrics = db->getMetrics();
+    EXPECT_LT(0, metrics.busyRetries);
+    EXPECT_EQ(1, metrics.busyTimeouts);
+    EXPECT_LE(15000, metrics.busyWaitMicros);
+
+    // the lock is released while the transaction waits for it
+    db->setBusyTimeout(5000);
+    thread release([=]() {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        sqlite3_exec(other, "COMMIT", nullptr, nullptr, nullptr);
+    });
+    db->beginTransaction(MadDatabase::TransactionMode::IMMEDIATE);
+    release.join();
+    sqlite3_close(other);
+
+    auto cv = MadContentValues();
+    cv.putInteger("keyInt", 42);
+    EXPECT_TRUE(db->insert("test", cv));
+    db->commitTransaction();
+    EXPECT_EQ("", db->getError());
+    EXPECT_EQ(1, db->getMetrics().busyTimeouts);
+
+    auto query = db->query("SELECT keyInt FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(42, query.getInt(0));
+}
+
+TEST(MadDatabaseTests, ReaderConnectionsBusy) {
+    string dbFileName = "test_reader_busy_db.s3db";
+    remove(dbFileName.c_str());
+    {
+        auto db = MadDatabase::openDatabase(dbFileName);
+        db->exec("CREATE TABLE test(keyInt INTEGER);");
+        db->exec("INSERT INTO test VALUES (42);");
+    }
+
+    MadDatabase::OpenOptions options;
+    options.readOnly = true;
+    options.readerConnections = 3;
+    auto db = MadDatabase::openDatabase(dbFileName, options);
+    EXPECT_EQ("", db->getError());
+
+    // every connection reports the query that failed on it
+    for (int i = 0; i < 3; ++i) {
+        {
+            auto query = db->query("SELECT * FROM missing_table;");
+            EXPECT_EQ("no such table: missing_table", db->getError());
+        }
+        auto query = db->query("SELECT keyInt FROM test;");
+        EXPECT_TRUE(query.moveToFirst());
+        EXPECT_EQ("", db->getError());
+    }
+
+    sqlite3 *other;
+    sqlite3_open(dbFileName.c_str(), &other);
+    sqlite3_exec(other, "BEGIN EXCLUSIVE", nullptr, nullptr, nullptr);
+
+    // the handler applies to the reader connections and their waits count in the metrics
+    atomic<int> calls{0};
+    db->setBusyHandler([&calls](int retryCount) {
+        ++calls;
+        return false;
+    });
+    for (int i = 0; i < 3; ++i) {
+        auto query = db->query("SELECT keyInt FROM test;");
+        EXPECT_FALSE(query.moveToFirst());
+        EXPECT_EQ("database is locked", db->getError());
+    }
+    EXPECT_EQ(3, calls);
+    EXPECT_EQ(3, db->getMetrics().busyTimeouts);
+
+    sqlite3_exec(other, "COMMIT", nullptr, nullptr, nullptr);
+    sqlite3_close(other);
+    auto query = db->query("SELECT keyInt FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(42, query.getInt(0));
+}
+
+TEST(MadDatabaseTests, GroupCommit) {
+    string dbFileName = "test_group_db.s3db";
+    remove(dbFileName.c_str());
+
+    auto db = MadDatabase::openDatabase(dbFileName);
+    db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+    MadDatabase::GroupCommitOptions options;
+    options.windowMicros = 2000;
+    options.maxRows = 16;
+    db->setGroupCommit(true, options);
+
+    auto threads = vector<thread>();
+    for (int i = 0; i < 8; ++i) {
+        threads.push_back(thread([=]() {
+            for (int j = 0; j < 10; ++j) {
+                db->beginTransaction();
+                auto cv = MadContentValues();
+                cv.putString("keyText", testData.dataAt(j));
+                cv.putInteger("keyIdx", i * 10 + j);
+                EXPECT_TRUE(db->insert("test", cv));
+                if (j % 5 == 4) {
+                    db->rollbackTransaction();
+                } else if (j % 5 == 3) {
+                    EXPECT_TRUE(db->insert("missing_table", cv));
+                    EXPECT_FALSE(db->commitTransaction());
+                } else {
+                    EXPECT_TRUE(db->commitTransaction());
+                }
+            }
+        }));
+    }
+    for (auto &&t : threads) {
+        t.join();
+    }
+
+    auto query = db->query("SELECT count(*), sum(keyIdx % 5) FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(48, query.getInt(0));
+    EXPECT_EQ(48, query.getInt(1));
+}
+
+static long long countRows(sqlite3 *connection, string const &table) {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(connection, ("SELECT count(*) FROM " + table).c_str(), -1, &stmt, 0);
+    sqlite3_step(stmt);
+    auto count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+#ifndef _WIN32
+/**
+ * Whether another process sees the RESERVED lock of sqlite's locking protocol on the file. Locks of sqlite are POSIX
+ * locks which conflict between processes only, the child asks the kernel directly because it inherits the lock state
+ * sqlite keeps in memory.
+ */
+static bool isReservedForOtherProcess(string const &path) {
+    pid_t child = fork();
+    if (child == 0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct flock lock = {};
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+        lock.l_start = 0x40000001;
+        lock.l_len = 1;
+        bool isLocked = fd >= 0 && fcntl(fd, F_GETLK, &lock) == 0 && lock.l_type != F_UNLCK;
+        _exit(isLocked ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+#endif
+
+TEST(MadDatabaseTests, AutoBatch) {
+    string dbFileName = "test_batch_db.s3db";
+    remove(dbFileName.c_str());
+
+    auto db = MadDatabase::openDatabase(dbFileName);
+    db->exec("CREATE TABLE test(keyInt INTEGER);");
+    MadDatabase::AutoBatchOptions options;
+    options.maxRows = 10;
+    options.maxDelayMillis = 0;
+    db->setAutoBatch(true, options);
+
+    sqlite3 *other;
+    sqlite3_open(dbFileName.c_str(), &other);
+
+    auto cv = MadContentValues();
+    for (int i = 0; i < 5; ++i) {
+        cv.putInteger("keyInt", i);
+        EXPECT_TRUE(db->insert("test", cv));
+    }
+    EXPECT_EQ(0, countRows(other, "test"));
+    auto query = db->query("SELECT count(*) FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(5, query.getInt(0));
+
+    EXPECT_TRUE(db->flush());
+    EXPECT_EQ(5, countRows(other, "test"));
+
+    // the row threshold commits the batch
+    for (int i = 0; i < 12; ++i) {
+        cv.putInteger("keyInt", i);
+        EXPECT_TRUE(db->insert("test", cv));
+    }
+    EXPECT_EQ(15, countRows(other, "test"));
+
+    // the timer commits the batch
+    options.maxDelayMillis = 10;
+    db->setAutoBatch(true, options);
+    EXPECT_TRUE(db->insert("test", cv));
+    this_thread::sleep_for(chrono::milliseconds(200));
+    EXPECT_EQ(18, countRows(other, "test"));
+
+    // disabling commits the batch
+    EXPECT_TRUE(db->insert("test", cv));
+    db->setAutoBatch(false);
+    EXPECT_EQ(19, countRows(other, "test"));
+
+    sqlite3_close(other);
+}
+
+TEST(MadDatabaseTests, TransactionPerThread) {
+    auto db = shared_ptr<MadDatabase>(MadDatabase::openInMemoryDatabase());
+    db->exec("CREATE TABLE test(keyInt INTEGER);");
+
+    auto cv = MadContentValues();
+    db->beginTransaction();
+    cv.putInteger("keyInt", 1);
+    EXPECT_TRUE(db->insert("test", cv));
+
+    // another thread's insert and commit wait for this thread's transaction instead of joining it
+    thread other([=]() {
+        auto otherCv = MadContentValues();
+        otherCv.putInteger("keyInt", 2);
+        EXPECT_TRUE(db->insert("test", otherCv));
+        EXPECT_FALSE(db->commitTransaction());
+    });
+    this_thread::sleep_for(chrono::milliseconds(20));
+    db->rollbackTransaction();
+    other.join();
+
+    auto query = db->query("SELECT keyInt FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(2, query.getInt(0));
+    EXPECT_TRUE(query.moveToNext());
+    EXPECT_TRUE(query.isAfterLast());
+}
+
+TEST(MadDatabaseTests, OpenOptions) {
+    string dbFileName = "test_options_db.s3db";
+    remove(dbFileName.c_str());
+
+    MadDatabase::OpenOptions options;
+    options.pageSize = 8192;
+    options.journalMode = MadDatabase::JournalMode::WAL;
+    options.synchronous = MadDatabase::Synchronous::NORMAL;
+    options.cacheSize = -4000;
+    options.mmapSize = 1024 * 1024;
+    options.tempStore = MadDatabase::TempStore::MEMORY;
+    options.busyTimeoutMillis = 100;
+    auto db = MadDatabase::openDatabase(dbFileName, options);
+    EXPECT_EQ("", db->getError());
+
+    auto pragma = [&](string const &name) {
+        auto query = db->query("PRAGMA " + name + ";");
+        EXPECT_TRUE(query.moveToFirst());
+        return query.getString(0);
+    };
+    EXPECT_EQ("8192", pragma("page_size"));
+    EXPECT_EQ("wal", pragma("journal_mode"));
+    EXPECT_EQ("1", pragma("synchronous"));
+    EXPECT_EQ("-4000", pragma("cache_size"));
+    EXPECT_EQ("2", pragma("temp_store"));
+
+    // an open database is shared as is
+    EXPECT_EQ(db, MadDatabase::openDatabase(dbFileName));
+}
+
+TEST(MadDatabaseTests, ImmutableReaders) {
+    string dbFileName = "test_immutable_db.s3db";
+    remove(dbFileName.c_str());
+    {
+        auto db = MadDatabase::openDatabase(dbFileName);
+        db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        db->beginTransaction();
+        auto cv = MadContentValues();
+        for (int i = 0; i < testData.size; ++i) {
+            cv.putString("keyText", testData.dataAt(i));
+            cv.putInteger("keyIdx", i);
+            db->insert("test", cv);
+        }
+        db->commitTransaction();
+    }
+
+    MadDatabase::OpenOptions options;
+    options.immutable = true;
+    options.readerConnections = 4;
+    auto db = MadDatabase::openDatabase(dbFileName, options);
+    EXPECT_EQ("", db->getError());
+
+    auto cv = MadContentValues();
+    cv.putInteger("keyIdx", -1);
+    EXPECT_FALSE(db->insert("test", cv));
+
+    auto threads = vector<thread>();
+    for (int i = 0; i < 8; ++i) {
+        threads.push_back(thread([=]() {
+            for (int j = 0; j < testData.size; ++j) {
+                auto query = db->query("SELECT keyText FROM test WHERE keyIdx = ?;", {to_string(j)});
+                EXPECT_TRUE(query.moveToFirst());
+                EXPECT_EQ(testData.dataAt(j), query.getString(0));
+            }
+        }));
+    }
+    for (auto &&t : threads) {
+        t.join();
+    }
+}
+
+TEST(MadDatabaseTests, RegistrySharesByFile) {
+    string dbFileName = "test_registry_db.s3db";
+    remove(dbFileName.c_str());
+
+    auto db = MadDatabase::openDatabase(dbFileName);
+    EXPECT_EQ(db, MadDatabase::openDatabase("./" + dbFileName));
+
+    weak_ptr<MadDatabase> released = db;
+    db.reset();
+    EXPECT_TRUE(released.expired());
+
+    auto reopened = MadDatabase::openDatabase("test_registry_db.s3db");
+    EXPECT_TRUE(reopened != nullptr);
+    EXPECT_EQ(reopened, MadDatabase::openDatabase("./test_registry_db.s3db"));
+}
+
+TEST(MadDatabaseTests, NamedInMemory) {
+    MadDatabase::OpenOptions options;
+    options.readerConnections = 3;
+    auto db = MadDatabase::openInMemoryDatabase("test_cache", options);
+    EXPECT_EQ("", db->getError());
+    EXPECT_EQ(db, MadDatabase::openInMemoryDatabase("test_cache"));
+    EXPECT_NE(db, MadDatabase::openInMemoryDatabase("other_cache"));
+
+    db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+    auto cv = MadContentValues();
+    for (int i = 0; i < testData.size; ++i) {
+        cv.putString("keyText", testData.dataAt(i));
+        cv.putInteger("keyIdx", i);
+        EXPECT_TRUE(db->insert("test", cv));
+    }
+
+    auto threads = vector<thread>();
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(thread([=]() {
+            auto dbt = MadDatabase::openInMemoryDatabase("test_cache");
+            for (int j = 0; j < testData.size; ++j) {
+                auto query = dbt->query("SELECT keyText FROM test WHERE keyIdx = ?;", {to_string(j)});
+                EXPECT_TRUE(query.moveToFirst());
+                EXPECT_EQ(testData.dataAt(j), query.getString(0));
+            }
+        }));
+    }
+    for (auto &&t : threads) {
+        t.join();
+    }
+
+    // the database is gone once closed
+    db.reset();
+    db = MadDatabase::openInMemoryDatabase("test_cache");
+    auto query = db->query("SELECT * FROM test;");
+    EXPECT_NE("", db->getError());
+}
+
+TEST(MadDatabaseTests, Backup) {
+    string dbFileName = "test_backup_source_db.s3db";
+    string backupFileName = "test_backup_db.s3db";
+    remove(dbFileName.c_str());
+    remove(backupFileName.c_str());
+
+    auto db = MadDatabase::openDatabase(dbFileName);
+    db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+    db->beginTransaction();
+    auto cv = MadContentValues();
+    for (int i = 0; i < 2000; ++i) {
+        cv.putString("keyText", testData.dataAt(i % testData.size));
+        cv.putInteger("keyIdx", i);
+        db->insert("test", cv);
+    }
+    db->commitTransaction();
+
+    int steps = 0;
+    EXPECT_TRUE(db->backupTo(backupFileName, 2, 0, [&](int remaining, int total) {
+        ++steps;
+        EXPECT_LE(remaining, total);
+        return true;
+    }));
+    EXPECT_LT(1, steps);
+
+    auto copy = MadDatabase::openInMemoryDatabase();
+    EXPECT_TRUE(db->backupTo(*copy));
+    auto query = copy->query("SELECT count(*) FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(2000, query.getInt(0));
+
+    // inserts proceed while a backup runs in the background
+    auto backup = db->backupToAsync(backupFileName, 1, 1);
+    for (int i = 2000; i < 2010; ++i) {
+        cv.putInteger("keyIdx", i);
+        EXPECT_TRUE(db->insert("test", cv));
+    }
+    EXPECT_TRUE(backup.get());
+
+    sqlite3 *restored;
+    sqlite3_open(backupFileName.c_str(), &restored);
+    EXPECT_LE(2000, countRows(restored, "test"));
+    sqlite3_close(restored);
+
+    // a progress callback may abort the backup
+    EXPECT_FALSE(db->backupTo(backupFileName, 1, 0, [](int, int) { return false; }));
+}
+
+TEST(MadDatabaseTests, Preload) {
+    string dbFileName = "test_preload_db.s3db";
+    remove(dbFileName.c_str());
+    {
+        auto db = MadDatabase::openDatabase(dbFileName);
+        db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        auto cv = MadContentValues();
+        cv.putString("keyText", "preloaded");
+        cv.putInteger("keyIdx", 1);
+        EXPECT_TRUE(db->insert("test", cv));
+    }
+
+    MadDatabase::OpenOptions options;
+    options.preload = true;
+    options.preloadReadAheadThreads = 2;
+    options.preloadWriteBack = MadDatabase::WriteBack::ON_CLOSE;
+    {
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        auto query = db->query("SELECT count(*) FROM test;");
+        EXPECT_TRUE(query.moveToFirst());
+        EXPECT_EQ(1, query.getInt(0));
+
+        auto cv = MadContentValues();
+        cv.putString("keyText", "written back");
+        cv.putInteger("keyIdx", 2);
+        EXPECT_TRUE(db->insert("test", cv));
+
+        // the file is untouched until the database is closed
+        sqlite3 *file;
+        sqlite3_open(dbFileName.c_str(), &file);
+        EXPECT_EQ(1, countRows(file, "test"));
+        sqlite3_close(file);
+    }
+
+    sqlite3 *file;
+    sqlite3_open(dbFileName.c_str(), &file);
+    EXPECT_EQ(2, countRows(file, "test"));
+    sqlite3_close(file);
+
+    options.preloadWriteBack = MadDatabase::WriteBack::PERIODIC;
+    options.preloadWriteBackMillis = 10;
+    {
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        db->exec("DELETE FROM test;");
+        this_thread::sleep_for(chrono::milliseconds(200));
+        sqlite3_open(dbFileName.c_str(), &file);
+        EXPECT_EQ(0, countRows(file, "test"));
+        sqlite3_close(file);
+    }
+}
+
+static long long pageSizeOf(string const &path) {
+    sqlite3 *file;
+    sqlite3_open(path.c_str(), &file);
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(file, "PRAGMA page_size;", -1, &stmt, 0);
+    long long pageSize = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+    sqlite3_finalize(stmt);
+    sqlite3_close(file);
+    return pageSize;
+}
+
+TEST(MadDatabaseTests, PreloadPageSize) {
+    string dbFileName = "test_preload_page_size_db.s3db";
+    remove(dbFileName.c_str());
+    MadDatabase::OpenOptions options;
+    options.pageSize = 8192;
+    {
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        db->exec("INSERT INTO test VALUES ('preloaded', 1);");
+    }
+    EXPECT_EQ(8192, pageSizeOf(dbFileName));
+
+    // the copy in memory takes the page size of the file, whatever the options ask for
+    options.preload = true;
+    options.preloadWriteBack = MadDatabase::WriteBack::ON_CLOSE;
+    for (int pageSize : {0, 1024, 8192}) {
+        options.pageSize = pageSize;
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        auto query = db->query("SELECT count(*) FROM test;");
+        EXPECT_TRUE(query.moveToFirst()) << "page size " << pageSize;
+        EXPECT_EQ(1, query.getInt(0)) << "page size " << pageSize;
+    }
+    EXPECT_EQ(8192, pageSizeOf(dbFileName));
+
+    // a new file is created with the page size of the options
+    remove(dbFileName.c_str());
+    options.pageSize = 2048;
+    {
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        db->exec("INSERT INTO test VALUES ('written back', 1);");
+    }
+    EXPECT_EQ(2048, pageSizeOf(dbFileName));
+    sqlite3 *file;
+    sqlite3_open(dbFileName.c_str(), &file);
+    EXPECT_EQ(1, countRows(file, "test"));
+    sqlite3_close(file);
+}
+
+TEST(MadDatabaseTests, InstrumentedVfs) {
+    string dbFileName = "test_vfs_db.s3db";
+    remove(dbFileName.c_str());
+
+    MadDatabase::VfsOptions vfsOptions;
+    vfsOptions.pageCacheBytes = 4 * 1024 * 1024;
+    EXPECT_TRUE(MadDatabase::installInstrumentedVfs(vfsOptions));
+
+    MadDatabase::OpenOptions options;
+    options.instrumentedVfs = true;
+    {
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        db->beginTransaction();
+        auto cv = MadContentValues();
+        for (int i = 0; i < 2000; ++i) {
+            cv.putString("keyText", testData.dataAt(i % testData.size));
+            cv.putInteger("keyIdx", i);
+            db->insert("test", cv);
+        }
+        db->commitTransaction();
+    }
+    for (int i = 0; i < 2; ++i) {
+        // the second scan is served by the page cache which outlives the connection
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        auto query = db->query("SELECT sum(length(keyText)) FROM test;");
+        EXPECT_TRUE(query.moveToFirst());
+    }
+
+    MadDatabase::IoStats stats;
+    for (auto &&entry : MadDatabase::getIoStats()) {
+        auto &path = entry.first;
+        if (path.size() >= dbFileName.size() &&
+            path.compare(path.size() - dbFileName.size(), dbFileName.size(), dbFileName) == 0) {
+            stats = entry.second;
+        }
+    }
+    EXPECT_LT(0, stats.writes);
+    EXPECT_LT(0, stats.bytesWritten);
+    EXPECT_LT(0, stats.syncs);
+    EXPECT_LT(0, stats.reads);
+    EXPECT_LT(0, stats.readAheads);
+    EXPECT_LT(0, stats.cacheHits);
+
+    MadDatabase::installInstrumentedVfs();
+}
+
+#ifndef _WIN32
+TEST(MadDatabaseTests, InstrumentedVfsKeepsLocks) {
+    string dbFileName = "test_vfs_locks_db.s3db";
+    remove(dbFileName.c_str());
+    EXPECT_TRUE(MadDatabase::installInstrumentedVfs());
+
+    MadDatabase::OpenOptions options;
+    options.instrumentedVfs = true;
+    auto db = MadDatabase::openDatabase(dbFileName, options);
+    db->exec("CREATE TABLE test (keyText TEXT);");
+    db->exec("INSERT INTO test WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2000) "
+             "SELECT printf('%0500d', i) FROM n;");
+    db->beginTransaction(MadDatabase::TransactionMode::IMMEDIATE);
+    EXPECT_TRUE(isReservedForOtherProcess(dbFileName));
+
+    // another connection of the process reads the file sequentially, with read ahead, and closes
+    sqlite3 *reader;
+    sqlite3_open_v2(dbFileName.c_str(), &reader, SQLITE_OPEN_READONLY, "madsqlite");
+    EXPECT_EQ(2000, countRows(reader, "test WHERE length(keyText) = 500"));
+    sqlite3_close(reader);
+
+    EXPECT_TRUE(isReservedForOtherProcess(dbFileName));
+    db->rollbackTransaction();
+    EXPECT_FALSE(isReservedForOtherProcess(dbFileName));
+}
+#endif
+
+static string fileContents(string const &path) {
+    string contents;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file) {
+        char buffer[4096];
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            contents.append(buffer, size);
+        }
+        fclose(file);
+    }
+    return contents;
+}
+
+TEST(MadDatabaseTests, ArenaPageCache) {
+    // every database opened by the earlier tests is closed
+    MadDatabase::PageCacheOptions options;
+    options.arenaBytes = 64 * (4096 + 512);
+    EXPECT_TRUE(MadDatabase::installArenaPageCache(options));
+    EXPECT_FALSE(MadDatabase::installArenaPageCache(options));
+    EXPECT_EQ(64, MadDatabase::getPageCacheStats().capacityPages);
+
+    string dbFileName = "test_arena_db.s3db";
+    remove(dbFileName.c_str());
+    {
+        auto db = MadDatabase::openDatabase(dbFileName);
+        auto other = MadDatabase::openInMemoryDatabase();
+        db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        other->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        db->beginTransaction();
+        auto cv = MadContentValues();
+        for (int i = 0; i < 5000; ++i) {
+            cv.putString("keyText", string(200, (char) ('a' + i % 26)));
+            cv.putInteger("keyIdx", i);
+            db->insert("test", cv);
+            other->insert("test", cv);
+        }
+        db->commitTransaction();
+
+        auto query = db->query("SELECT count(*) FROM test;");
+        EXPECT_TRUE(query.moveToFirst());
+        EXPECT_EQ(5000, query.getInt(0));
+        auto otherQuery = other->query("SELECT count(*) FROM test;");
+        EXPECT_TRUE(otherQuery.moveToFirst());
+        EXPECT_EQ(5000, otherQuery.getInt(0));
+
+        // the file database is bounded by the arena, the in memory database can never give its pages back
+        auto stats = MadDatabase::getPageCacheStats();
+        EXPECT_EQ(64, stats.usedPages);
+        EXPECT_LT(0, stats.heapPages);
+        EXPECT_LT(0, stats.evictions);
+        EXPECT_LT(0, stats.hits);
+    }
+
+    // a write transaction takes the clean pages of earlier reads, spilling its dirty pages would write the file
+    sqlite3 *connection;
+    ASSERT_EQ(SQLITE_OK, sqlite3_open(dbFileName.c_str(), &connection));
+    EXPECT_EQ(SQLITE_OK, sqlite3_exec(connection, "PRAGMA cache_size = 10; PRAGMA cache_spill = 10; "
+                                                  "SELECT sum(length(keyText)) FROM test;", nullptr, nullptr, nullptr));
+    auto committed = fileContents(dbFileName);
+    EXPECT_EQ(SQLITE_OK, sqlite3_exec(connection, "BEGIN; UPDATE test SET keyIdx = -1 WHERE rowid % 250 = 0;",
+                                      nullptr, nullptr, nullptr));
+    EXPECT_TRUE(committed == fileContents(dbFileName));
+    EXPECT_EQ(SQLITE_OK, sqlite3_exec(connection, "COMMIT;", nullptr, nullptr, nullptr));
+    EXPECT_EQ(20, countRows(connection, "test WHERE keyIdx = -1"));
+    sqlite3_close(connection);
+}
+
+TEST(MadDatabaseTests, ArenaPageCacheLargePages) {
+    // the arena installed by ArenaPageCache holds 64 slots of 4096 byte pages
+    string dbFileName = "test_arena_large_db.s3db";
+    remove(dbFileName.c_str());
+    MadDatabase::OpenOptions options;
+    options.pageSize = 16384;
+    auto db = MadDatabase::openDatabase(dbFileName, options);
+    db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+    db->beginTransaction();
+    auto cv = MadContentValues();
+    for (int i = 0; i < 5000; ++i) {
+        cv.putString("keyText", string(200, (char) ('a' + i % 26)));
+        cv.putInteger("keyIdx", i);
+        db->insert("test", cv);
+    }
+    db->commitTransaction();
+    auto query = db->query("SELECT sum(length(keyText)) FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(1000000, query.getInt(0));
+
+    // the pages never fit a slot, the heap pages reuse each other within the bytes of the arena
+    auto budgetPages = 64 * (4096 + 512) / 16384;
+    auto stats = MadDatabase::getPageCacheStats();
+    EXPECT_LT(0, stats.heapPages);
+    EXPECT_GE(budgetPages, stats.heapPages);
+    EXPECT_LT(0, stats.evictions);
+
+    // and are held to the cache size of the database
+    db->exec("PRAGMA cache_size = 4;");
+    auto sum = db->query("SELECT sum(keyIdx) FROM test;");
+    EXPECT_TRUE(sum.moveToFirst());
+    EXPECT_GE(4, MadDatabase::getPageCacheStats().heapPages);
+}
+
+/**
+ * Frees sqlite memory from the destructor of a thread local, when the thread exits.
+ */
+struct ExitingThreadMemory {
+    void *memory = nullptr;
+
+    ~ExitingThreadMemory() {
+        sqlite3_free(memory);
+        sqlite3_free(sqlite3_malloc(64));
+    }
+};
+
+static thread_local ExitingThreadMemory exitingThreadMemory;
+
+TEST(MadDatabaseTests, ThreadCacheAllocator) {
+    // every database opened by the earlier tests is closed
+    MadDatabase::AllocatorOptions options;
+    options.allocator = MadDatabase::Allocator::THREAD_CACHE;
+    {
+        // sqlite can not be shut down under an open connection
+        auto open = MadDatabase::openInMemoryDatabase();
+        EXPECT_FALSE(MadDatabase::installAllocator(options));
+    }
+    EXPECT_TRUE(MadDatabase::installAllocator(options));
+
+    // constructed before the thread's cache of the allocator, destroyed after it
+    thread([]() {
+        exitingThreadMemory.memory = nullptr;
+        exitingThreadMemory.memory = sqlite3_malloc(64);
+        sqlite3_free(sqlite3_malloc(64));
+    }).join();
+
+    MadDatabase::OpenOptions openOptions;
+    openOptions.lookasideSlotSize = 128;
+    openOptions.lookasideSlots = 256;
+    auto db = MadDatabase::openInMemoryDatabase(openOptions);
+    db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&db, t]() {
+            auto cv = MadContentValues();
+            for (int i = 0; i < 250; ++i) {
+                cv.putString("keyText", testData.dataAt(i % testData.size));
+                cv.putInteger("keyIdx", t * 250 + i);
+                db->insert("test", cv);
+            }
+        });
+    }
+    for (auto &&t : threads) {
+        t.join();
+    }
+    auto query = db->query("SELECT count(*) FROM test;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ(1000, query.getInt(0));
+
+    auto stats = MadDatabase::getAllocatorStats();
+    EXPECT_LT(0, stats.memoryUsed);
+    EXPECT_LE(stats.memoryUsed, stats.memoryHighwater);
+    EXPECT_LT(0, stats.threadCacheHits);
+}
+
+static long long fileSize(string const &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+TEST(MadDatabaseTests, CompressedVfs) {
+    string plainFileName = "test_plain_db.s3db";
+    string compressedFileName = "test_compressed_db.s3db";
+    remove(plainFileName.c_str());
+    remove(compressedFileName.c_str());
+
+    MadDatabase::OpenOptions options;
+    options.compressed = true;
+    for (auto &&fileName : {plainFileName, compressedFileName}) {
+        auto db = MadDatabase::openDatabase(fileName, fileName == compressedFileName ? options
+                                                                                     : MadDatabase::OpenOptions());
+        db->exec("CREATE TABLE tiles (keyIdx INTEGER PRIMARY KEY, tile BLOB);");
+        db->beginTransaction();
+        auto cv = MadContentValues();
+        for (int i = 0; i < 200; ++i) {
+            vector<unsigned char> tile(8000);
+            for (size_t j = 0; j < tile.size(); ++j) {
+                tile[j] = (unsigned char) ((j / 64 + i) % 7);
+            }
+            cv.putInteger("keyIdx", i);
+            cv.putBlob("tile", tile);
+            db->insert("tiles", cv);
+        }
+        db->commitTransaction();
+        // rewritten and freed pages
+        db->exec("UPDATE tiles SET tile = zeroblob(100) WHERE keyIdx % 3 = 0;");
+        db->exec("DELETE FROM tiles WHERE keyIdx % 5 = 0;");
+    }
+    EXPECT_LT(fileSize(compressedFileName), fileSize(plainFileName) / 2);
+
+    auto db = MadDatabase::openDatabase(compressedFileName, options);
+    auto query = db->query("PRAGMA integrity_check;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ("ok", query.getString(0));
+    auto tileQuery = db->query("SELECT tile FROM tiles WHERE keyIdx = 7;");
+    EXPECT_TRUE(tileQuery.moveToFirst());
+    auto tile = tileQuery.getBlob(0);
+    EXPECT_EQ(8000u, tile.size());
+    EXPECT_EQ((unsigned char) ((100 / 64 + 7) % 7), tile[100]);
+    auto count = db->query("SELECT count(*) FROM tiles;");
+    EXPECT_TRUE(count.moveToFirst());
+    EXPECT_EQ(160, count.getInt(0));
+
+    // a compressed database is not a sqlite file
+    sqlite3 *plain;
+    sqlite3_open(compressedFileName.c_str(), &plain);
+    EXPECT_NE(SQLITE_OK, sqlite3_exec(plain, "SELECT count(*) FROM tiles;", nullptr, nullptr, nullptr));
+    sqlite3_close(plain);
+}
+
+static void overwriteFile(string const &path, long long offset, string const &bytes) {
+    FILE *file = fopen(path.c_str(), "r+b");
+    ASSERT_TRUE(file != nullptr);
+    fseek(file, (long) offset, SEEK_SET);
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+}
+
+TEST(MadDatabaseTests, CompressedVfsTornRecords) {
+    string fileName = "test_compressed_torn.bin";
+    remove(fileName.c_str());
+    MadDatabase::OpenOptions options;
+    options.compressed = true;
+    MadDatabase::openInMemoryDatabase("test_compressed_install", options);
+    auto vfs = sqlite3_vfs_find("madsqlite-lz4");
+    ASSERT_TRUE(vfs != nullptr);
+    vector<sqlite3_int64> fileMemory((size_t) vfs->szOsFile / sizeof(sqlite3_int64) + 1);
+    auto file = reinterpret_cast<sqlite3_file *>(fileMemory.data());
+    int flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE;
+    const int pageSize = 4096;
+    vector<char> page(pageSize);
+    auto writePage = [&](int pageNumber, int content) {
+        for (int i = 0; i < pageSize; ++i) {
+            // compressible unless content is negative
+            page[i] = content < 0 ? (char) (rand() & 0xFF) : (char) ((i / 64 + content) % 7);
+        }
+        EXPECT_EQ(SQLITE_OK, file->pMethods->xWrite(file, page.data(), pageSize, (sqlite3_int64) pageNumber * pageSize));
+    };
+
+    ASSERT_EQ(SQLITE_OK, vfs->xOpen(vfs, fileName.c_str(), file, flags, &flags));
+    for (int i = 0; i < 16; ++i) {
+        writePage(i, i);
+    }
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xSync(file, SQLITE_SYNC_NORMAL));
+    for (int i = 0; i < 16; ++i) {
+        writePage(i, i + 1);
+    }
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xSync(file, SQLITE_SYNC_NORMAL));
+    // incompressible pages stored as they are, appended behind the free records of the first pages
+    auto rawOffset = fileSize(fileName);
+    writePage(16, -1);
+    vector<char> rawPage = page;
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xSync(file, SQLITE_SYNC_NORMAL));
+    writePage(17, -1);
+    vector<char> lastPage = page;
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xSync(file, SQLITE_SYNC_NORMAL));
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xClose(file));
+
+    // a torn write of the free extent of the first record, the records behind it are intact
+    overwriteFile(fileName, 1024, string(100, 'x'));
+    flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE;
+    ASSERT_EQ(SQLITE_OK, vfs->xOpen(vfs, fileName.c_str(), file, flags, &flags));
+    vector<char> read(pageSize);
+    for (int i = 0; i < 16; ++i) {
+        EXPECT_EQ(SQLITE_OK, file->pMethods->xRead(file, read.data(), pageSize, (sqlite3_int64) i * pageSize));
+        EXPECT_EQ((char) ((100 / 64 + i + 1) % 7), read[100]) << "page " << i;
+    }
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xRead(file, read.data(), pageSize, 16 * pageSize));
+    EXPECT_EQ(rawPage, read);
+    // pages written after the torn record do not overwrite the records behind it
+    writePage(0, 30);
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xSync(file, SQLITE_SYNC_NORMAL));
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xRead(file, read.data(), pageSize, 17 * pageSize));
+    EXPECT_EQ(lastPage, read);
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xClose(file));
+
+    // a torn stored page fails to read instead of returning the torn bytes
+    overwriteFile(fileName, rawOffset + 1000, string(16, 'x'));
+    ASSERT_EQ(SQLITE_OK, vfs->xOpen(vfs, fileName.c_str(), file, flags, &flags));
+    EXPECT_EQ(SQLITE_CORRUPT, file->pMethods->xRead(file, read.data(), pageSize, 16 * pageSize));
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xClose(file));
+}
+
+#ifndef _WIN32
+TEST(MadDatabaseTests, CompressedVfsOtherProcess) {
+    string dbFileName = "test_compressed_process_db.s3db";
+    remove(dbFileName.c_str());
+    remove((dbFileName + "-wal").c_str());
+    remove((dbFileName + "-shm").c_str());
+    MadDatabase::OpenOptions options;
+    options.compressed = true;
+    options.journalMode = MadDatabase::JournalMode::WAL;
+    {
+        auto db = MadDatabase::openDatabase(dbFileName, options);
+        db->exec("CREATE TABLE test (keyIdx INTEGER PRIMARY KEY, keyText TEXT);");
+        db->exec("INSERT INTO test WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 500) "
+                 "SELECT i, printf('%0200d', 1) FROM n;");
+    }
+
+    int toChild[2];
+    int toParent[2];
+    ASSERT_EQ(0, pipe(toChild));
+    ASSERT_EQ(0, pipe(toParent));
+    pid_t child = fork();
+    if (child == 0) {
+        // a WAL connection keeps its SHARED lock while another process rewrites and checkpoints the file
+        sqlite3 *reader;
+        sqlite3_open_v2(dbFileName.c_str(), &reader, SQLITE_OPEN_READWRITE, "madsqlite-lz4");
+        bool isValid = countRows(reader, "test WHERE keyText = printf('%0200d', 1)") == 500;
+        char signal = 0;
+        isValid = write(toParent[1], &signal, 1) == 1 && isValid;
+        isValid = read(toChild[0], &signal, 1) == 1 && isValid;
+        isValid = countRows(reader, "test WHERE keyText = printf('%0200d', 2)") == 500 && isValid;
+        sqlite3_close(reader);
+        _exit(isValid ? 0 : 1);
+    }
+    char signal = 0;
+    ASSERT_EQ(1, read(toParent[0], &signal, 1));
+    {
+        sqlite3 *writer;
+        sqlite3_open_v2(dbFileName.c_str(), &writer, SQLITE_OPEN_READWRITE, "madsqlite-lz4");
+        // without syncs the file header is written when the locks are released
+        sqlite3_exec(writer, "PRAGMA synchronous=OFF;", nullptr, nullptr, nullptr);
+        for (int i = 0; i < 3; ++i) {
+            EXPECT_EQ(SQLITE_OK, sqlite3_exec(writer, ("UPDATE test SET keyText = printf('%0200d', " +
+                                                       to_string(i == 2 ? 2 : i + 3) + ");").c_str(),
+                                              nullptr, nullptr, nullptr));
+            EXPECT_EQ(SQLITE_OK, sqlite3_exec(writer, "PRAGMA wal_checkpoint(TRUNCATE);", nullptr, nullptr, nullptr));
+        }
+        sqlite3_close(writer);
+    }
+    ASSERT_EQ(1, write(toChild[1], &signal, 1));
+    int status = 0;
+    waitpid(child, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    for (int fd : {toChild[0], toChild[1], toParent[0], toParent[1]}) {
+        close(fd);
+    }
+}
+#endif
+
+TEST(MadDatabaseTests, AsyncIoVfs) {
+    for (int mode = 0; mode < 3; ++mode) {
+        string dbFileName = "test_async_io_db.s3db";
+        remove(dbFileName.c_str());
+        MadDatabase::OpenOptions options;
+        options.asyncIo = true;
+        options.directIo = mode == 2;
+        options.journalMode = mode == 0 ? MadDatabase::JournalMode::DELETE : MadDatabase::JournalMode::WAL;
+        {
+            auto db = MadDatabase::openDatabase(dbFileName, options);
+            db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+            auto cv = MadContentValues();
+            for (int batch = 0; batch < 10; ++batch) {
+                db->beginTransaction();
+                for (int i = 0; i < 200; ++i) {
+                    cv.putString("keyText", testData.dataAt(i % testData.size));
+                    cv.putInteger("keyIdx", batch * 200 + i);
+                    db->insert("test", cv);
+                }
+                db->commitTransaction();
+            }
+            db->exec("DELETE FROM test WHERE keyIdx % 2 = 0;");
+
+            // committed writes are visible to other connections
+            sqlite3 *other;
+            sqlite3_open(dbFileName.c_str(), &other);
+            EXPECT_EQ(1000, countRows(other, "test"));
+            sqlite3_close(other);
+        }
+        auto db = MadDatabase::openDatabase(dbFileName);
+        auto query = db->query("PRAGMA integrity_check;");
+        EXPECT_TRUE(query.moveToFirst());
+        EXPECT_EQ("ok", query.getString(0));
+    }
+}
+
+TEST(MadDatabaseTests, AsyncIoVfsRewrites) {
+    string fileName = "test_async_io_rewrite.bin";
+    remove(fileName.c_str());
+    MadDatabase::OpenOptions options;
+    options.asyncIo = true;
+    MadDatabase::openInMemoryDatabase("test_async_io_install", options);
+    auto vfs = sqlite3_vfs_find("madsqlite-uring");
+    if (!vfs) {
+        cout << "io_uring is unavailable" << endl;
+        return;
+    }
+    vector<sqlite3_int64> fileMemory((size_t) vfs->szOsFile / sizeof(sqlite3_int64) + 1);
+    auto file = reinterpret_cast<sqlite3_file *>(fileMemory.data());
+    int flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE;
+    ASSERT_EQ(SQLITE_OK, vfs->xOpen(vfs, fileName.c_str(), file, flags, &flags));
+
+    // every page is written again while earlier writes of it are queued or in flight
+    const int pageSize = 4096;
+    vector<char> page(pageSize);
+    for (int i = 0; i < 200; ++i) {
+        fill(page.begin(), page.end(), (char) i);
+        EXPECT_EQ(SQLITE_OK, file->pMethods->xWrite(file, page.data(), pageSize, (sqlite3_int64) (i % 8) * pageSize));
+    }
+    // and partly overwritten
+    string patch = "patched";
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xWrite(file, patch.data(), (int) patch.size(), 100));
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xSync(file, SQLITE_SYNC_NORMAL));
+    EXPECT_EQ(SQLITE_OK, file->pMethods->xClose(file));
+
+    FILE *written = fopen(fileName.c_str(), "rb");
+    ASSERT_TRUE(written != nullptr);
+    for (int p = 0; p < 8; ++p) {
+        ASSERT_EQ((size_t) pageSize, fread(page.data(), 1, (size_t) pageSize, written));
+        char expected = (char) (192 + p);
+        for (int i = 0; i < pageSize; ++i) {
+            bool isPatch = p == 0 && i >= 100 && i < 100 + (int) patch.size();
+            ASSERT_EQ(isPatch ? patch[i - 100] : expected, page[i]) << "page " << p << " byte " << i;
+        }
+    }
+    fclose(written);
+}
+
+#ifndef _WIN32
+TEST(MadDatabaseTests, AsyncIoVfsKeepsLocks) {
+    string dbFileName = "test_async_io_locks_db.s3db";
+    remove(dbFileName.c_str());
+    MadDatabase::OpenOptions options;
+    options.asyncIo = true;
+    options.directIo = true;
+    auto db = MadDatabase::openDatabase(dbFileName, options);
+    if (!sqlite3_vfs_find("madsqlite-uring")) {
+        cout << "io_uring is unavailable" << endl;
+        return;
+    }
+    db->exec("CREATE TABLE test (keyText TEXT);");
+    db->beginTransaction(MadDatabase::TransactionMode::IMMEDIATE);
+    EXPECT_TRUE(isReservedForOtherProcess(dbFileName));
+
+    // other connections of the process with and without direct I/O open the file and close
+    for (auto vfsName : {"madsqlite-uring", "madsqlite-uring-direct"}) {
+        sqlite3 *other;
+        sqlite3_open_v2(dbFileName.c_str(), &other, SQLITE_OPEN_READWRITE, vfsName);
+        EXPECT_EQ(0, countRows(other, "test"));
+        sqlite3_close(other);
+    }
+
+    EXPECT_TRUE(isReservedForOtherProcess(dbFileName));
+    db->rollbackTransaction();
+    EXPECT_FALSE(isReservedForOtherProcess(dbFileName));
+}
+#endif
+
+TEST(MadDatabaseTests, UnserializedConnections) {
+    // sqlite of the performance profile leaves serializing connections to the wrapper
+    sqlite3_shutdown();
+    ASSERT_EQ(SQLITE_OK, sqlite3_config(SQLITE_CONFIG_MULTITHREAD));
+    sqlite3_initialize();
+    {
+        MadDatabase::OpenOptions options;
+        options.readerConnections = 2;
+        auto db = MadDatabase::openInMemoryDatabase("unserialized", options);
+        db->exec("CREATE TABLE test (keyText TEXT, keyIdx INTEGER);");
+        vector<thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&db, t]() {
+                auto cv = MadContentValues();
+                for (int i = 0; i < 100; ++i) {
+                    cv.putString("keyText", testData.dataAt(i));
+                    cv.putInteger("keyIdx", t * 100 + i);
+                    db->insert("test", cv);
+                    auto query = db->query("SELECT keyText FROM test WHERE keyIdx = ?;", {to_string(t * 100 + i)});
+                    EXPECT_TRUE(query.moveToFirst());
+                    EXPECT_EQ(testData.dataAt(i), query.getString(0));
+                }
+            });
+        }
+        for (auto &&t : threads) {
+            t.join();
+        }
+        auto query = db->query("SELECT count(*) FROM test;");
+        EXPECT_TRUE(query.moveToFirst());
+        EXPECT_EQ(400, query.getInt(0));
+    }
+    sqlite3_shutdown();
+    sqlite3_config(SQLITE_CONFIG_SERIALIZED);
+    sqlite3_initialize();
+}
+
+TEST(MadDatabaseTests, LockWaitMetrics) {
+    auto db = MadDatabase::openInMemoryDatabase();
+    db->exec("CREATE TABLE test (keyIdx INTEGER);");
+    EXPECT_EQ(0, db->getMetrics().lockWaits);
+    db->beginTransaction();
+    thread writer([&db]() {
+        auto cv = MadContentValues();
+        cv.putInteger("keyIdx", 1);
+        db->insert("test", cv);
+    });
+    this_thread::sleep_for(chrono::milliseconds(50));
+    EXPECT_TRUE(db->commitTransaction());
+    writer.join();
+    auto metrics = db->getMetrics();
+    EXPECT_EQ(1, metrics.lockWaits);
+    EXPECT_LE(40000, metrics.lockWaitMicros);
+}
+
+TEST(MadDatabaseTests, ContentValuesReplaceType) {
+    auto db = MadDatabase::openInMemoryDatabase();
+    db->exec("CREATE TABLE test (keyA, keyB, keyC);");
+    auto cv = MadContentValues();
+    cv.putString("keyA", "text");
+    cv.putBlob("keyB", "blob", 4);
+    cv.putReal("keyC", 1.5);
+    // replacing a value keeps the column in place and changes its type
+    cv.putInteger("keyA", 7);
+    cv.putString("keyB", "");
+    EXPECT_TRUE(db->insert("test", cv));
+    cv.clear();
+    cv.putReal("keyC", 2.5);
+    EXPECT_TRUE(db->insert("test", cv));
+
+    auto query = db->query("SELECT typeof(keyA), keyA, typeof(keyB), keyB, keyC FROM test ORDER BY rowid;");
+    EXPECT_TRUE(query.moveToFirst());
+    EXPECT_EQ("integer", query.getString(0));
+    EXPECT_EQ(7, query.getInt(1));
+    EXPECT_EQ("text", query.getString(2));
+    EXPECT_EQ("", query.getString(3));
+    EXPECT_EQ(1.5, query.getReal(4));
+    EXPECT_TRUE(query.moveToNext());
+    EXPECT_EQ("null", query.getString(0));
+    EXPECT_EQ(2.5, query.getReal(4));
+}
+
+TEST(MadDatabaseTests, ContentValuesArena) {
+    auto db = MadDatabase::openInMemoryDatabase();
+    db->exec("CREATE TABLE test (keyText, keyBlob, keyInt);");
+    // an arena smaller than a row grows
+    auto cv = MadContentValues(4);
+    for (int i = 0; i < 3; ++i) {
+        cv.clear();
+        cv.putString("keyText", "first");
+        cv.putBlob("keyBlob", vector<unsigned char>((size_t) i + 1, (unsigned char) i));
+        // a replaced value leaves its bytes in the arena
+        cv.putString("keyText", "text" + to_string(i));
+        cv.putInteger("keyInt", i);
+        EXPECT_TRUE(db->insert("test", cv));
+    }
+    // fewer keys than the last row
+    cv.clear();
+    cv.putString("keyText", "last");
+    EXPECT_TRUE(db->insert("test", cv));
+
+    auto query = db->query("SELECT keyText, keyBlob, keyInt, typeof(keyBlob) FROM test ORDER BY rowid;");
+    EXPECT_TRUE(query.moveToFirst());
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ("text" + to_string(i), query.getString(0));
+        EXPECT_EQ(vector<unsigned char>((size_t) i + 1, (unsigned char) i), query.getBlob(1));
+        EXPECT_EQ(i, query.getInt(2));
+        EXPECT_TRUE(query.moveToNext());
+    }
+    EXPECT_EQ("last", query.getString(0));
+    EXPECT_EQ("null", query.getString(3));
+}
+
+TEST(MadDatabaseTests, InsertStatementReuse) {
+    auto db = MadDatabase::openInMemoryDatabase();
+    db->exec("CREATE TABLE first (keyA, keyB);");
+    db->exec("CREATE TABLE second (keyA, keyB);");
+    auto cv = MadContentValues();
+    for (int i = 0; i < 3; ++i) {
+        cv.clear();
+        cv.putInteger("keyA", i);
+        cv.putString("keyB", "b" + to_string(i));
+        EXPECT_TRUE(db->insert("first", cv));
+        EXPECT_TRUE(db->insert("second", cv));
+    }
+    // the same keys in another order are another statement
+    cv.clear();
+    cv.putString("keyB", "b3");
+    cv.putInteger("keyA", 3);
+    EXPECT_TRUE(db->insert("first", cv));
+    // more shapes than are cached
+    for (int i = 0; i < 40; ++i) {
+        db->exec("CREATE TABLE extra" + to_string(i) + " (keyA);");
+        cv.clear();
+        cv.putInteger("keyA", i);
+        EXPECT_TRUE(db->insert("extra" + to_string(i), cv));
+    }
+    // a cached statement of a table that was dropped and created again
+    db->exec("DROP TABLE second;");
+    cv.clear();
+    cv.putInteger("keyA", 4);
+    cv.putString("keyB", "b4");
+    EXPECT_FALSE(db->insert("second", cv));
+    db->exec("CREATE TABLE second (keyB, keyA);");
+    EXPECT_TRUE(db->insert("second", cv));
+
+    auto query = db->query("SELECT keyA, keyB FROM first ORDER BY rowid;");
+    int count = 0;
+    for (query.moveToFirst(); !query.isAfterLast(); query.moveToNext()) {
+        EXPECT_EQ(count, query.getInt(0));
+        EXPECT_EQ("b" + to_string(count), query.getString(1));
+        ++count;
+    }
+    EXPECT_EQ(4, count);
+    auto second = db->query("SELECT keyA, keyB FROM second;");
+    EXPECT_TRUE(second.moveToFirst());
+    EXPECT_EQ(4, second.getInt(0));
+    EXPECT_EQ("b4", second.getString(1));
+}
+
 TEST(MadDatabaseTests, Empty) {
     auto db = MadDatabase::openInMemoryDatabase();
     db->exec("CREATE TABLE test(keyInt INTEGER);");
@@ -0,0 +1,155 @@
+//
+// Created on 10/19/26.
+//
+#include "gtest/gtest.h"
+#include "MadLz4.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace madsqlite;
+using namespace std;
+
+/**
+ * Text like input: words of a small vocabulary, compressible by a factor of a few.
+ */
+static vector<char> textOf(int size) {
+    static const char *const words[] = {"the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog. "};
+    vector<char> text;
+    text.reserve((size_t) size);
+    while ((int) text.size() < size) {
+        const char *word = words[rand() % 8];
+        text.insert(text.end(), word, word + strlen(word));
+    }
+    text.resize((size_t) size);
+    return text;
+}
+
+static vector<char> randomOf(int size) {
+    vector<char> bytes((size_t) size);
+    for (auto &&byte : bytes) {
+        byte = (char) (rand() & 0xFF);
+    }
+    return bytes;
+}
+
+static vector<char> compressed(vector<char> const &input) {
+    vector<char> output((size_t) MadLz4::compressBound((int) input.size()));
+    int size = MadLz4::compress(input.data(), (int) input.size(), output.data(), (int) output.size());
+    output.resize((size_t) size);
+    return output;
+}
+
+static void expectRoundTrip(vector<char> const &input) {
+    auto output = compressed(input);
+    ASSERT_TRUE(!output.empty() || input.empty()) << "size " << input.size();
+    vector<char> decompressed(input.size());
+    EXPECT_EQ((int) input.size(), MadLz4::decompress(output.data(), (int) output.size(), decompressed.data(),
+                                                     (int) decompressed.size())) << "size " << input.size();
+    EXPECT_EQ(input, decompressed) << "size " << input.size();
+}
+
+TEST(MadLz4Tests, RoundTripSizes) {
+    srand(7);
+    for (int size : {0, 1, 4, 5, 12, 13, 16, 17, 31, 32, 33, 255, 256, 270, 512, 1000, 4096, 65536, 65537, 200000}) {
+        expectRoundTrip(textOf(size));
+        expectRoundTrip(vector<char>((size_t) size, 'a'));
+    }
+}
+
+TEST(MadLz4Tests, RoundTripMatches) {
+    srand(11);
+    // repeats of every period around the copy widths of the decompressor, overlapping their own output
+    for (int period = 1; period <= 40; ++period) {
+        auto pattern = randomOf(period);
+        vector<char> input;
+        while (input.size() < 3000) {
+            input.insert(input.end(), pattern.begin(), pattern.end());
+        }
+        expectRoundTrip(input);
+    }
+    // matches further back than the largest offset
+    auto block = randomOf(70000);
+    vector<char> input(block);
+    input.insert(input.end(), block.begin(), block.begin() + 1000);
+    expectRoundTrip(input);
+    // long literal runs and long matches, lengths past the 255 continuation bytes
+    auto literals = randomOf(600);
+    input = literals;
+    input.insert(input.end(), 600, 'z');
+    input.insert(input.end(), literals.begin(), literals.end());
+    expectRoundTrip(input);
+}
+
+TEST(MadLz4Tests, Incompressible) {
+    srand(13);
+    for (int size : {1, 13, 100, 4096, 65536}) {
+        auto input = randomOf(size);
+        expectRoundTrip(input);
+        EXPECT_LE((int) compressed(input).size(), MadLz4::compressBound(size));
+        // the compressed page store asks for a saving and stores incompressible pages as they are
+        vector<char> output((size_t) size);
+        EXPECT_EQ(0, MadLz4::compress(input.data(), size, output.data(), size - size / 8)) << "size " << size;
+    }
+}
+
+TEST(MadLz4Tests, DestinationTooSmall) {
+    srand(17);
+    auto input = textOf(4096);
+    auto output = compressed(input);
+    vector<char> decompressed(input.size() - 1);
+    EXPECT_EQ(-1, MadLz4::decompress(output.data(), (int) output.size(), decompressed.data(),
+                                     (int) decompressed.size()));
+    vector<char> small(output.size() - 1);
+    EXPECT_EQ(0, MadLz4::compress(input.data(), (int) input.size(), small.data(), (int) small.size()));
+}
+
+TEST(MadLz4Tests, Truncated) {
+    srand(19);
+    auto input = textOf(4096);
+    auto output = compressed(input);
+    vector<char> decompressed(input.size());
+    for (size_t size = 0; size < output.size(); ++size) {
+        int result = MadLz4::decompress(output.data(), (int) size, decompressed.data(), (int) decompressed.size());
+        // a cut at the end of a sequence is a valid shorter block
+        EXPECT_LT(result, (int) input.size()) << "size " << size;
+        if (result >= 0) {
+            EXPECT_EQ(0, memcmp(input.data(), decompressed.data(), (size_t) result)) << "size " << size;
+        }
+    }
+}
+
+TEST(MadLz4Tests, Malformed) {
+    vector<char> decompressed(256);
+    auto decompress = [&](string const &block) {
+        return MadLz4::decompress(block.data(), (int) block.size(), decompressed.data(), (int) decompressed.size());
+    };
+    // a match before the start of the output
+    EXPECT_EQ(-1, decompress(string("\x14" "abcd" "\x05\x00", 7)));
+    // a match of offset 0
+    EXPECT_EQ(-1, decompress(string("\x14" "abcd" "\x00\x00", 7)));
+    // literals past the end of the input
+    EXPECT_EQ(-1, decompress(string("\x50" "abc", 4)));
+    // a literal length whose continuation bytes run past the end of the input
+    EXPECT_EQ(-1, decompress(string("\xF0\xFF\xFF", 3)));
+    // a match length whose continuation bytes run past the end of the input
+    EXPECT_EQ(-1, decompress(string("\x1F" "a" "\x01\x00\xFF", 5)));
+    // a match past the end of the output
+    EXPECT_EQ(-1, decompress(string("\x1F" "a" "\x01\x00\xFF\x10", 6)));
+    // a lone offset byte
+    EXPECT_EQ(-1, decompress(string("\x10" "a" "\x01", 3)));
+    // a valid block for reference: a literal repeated by a match overlapping its own output
+    EXPECT_EQ(9, decompress(string("\x14" "a" "\x01\x00" "\x00", 5)));
+    EXPECT_EQ(string(9, 'a'), string(decompressed.data(), 9));
+
+    // random bytes fail or decompress within the destination, never past it
+    srand(23);
+    vector<char> guarded(256 + 64, 'g');
+    for (int i = 0; i < 20000; ++i) {
+        auto block = randomOf(1 + rand() % 64);
+        int result = MadLz4::decompress(block.data(), (int) block.size(), guarded.data(), 256);
+        ASSERT_GE(256, result);
+        ASSERT_EQ(string(64, 'g'), string(guarded.data() + 256, 64)) << "block " << i;
+    }
+}